@@ -0,0 +1,220 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+// Plugin-wide pool for delay memory. Buffers of every instance are carved out of 2 MB
+// chunks, backed by huge pages where the OS allows it, so a patch full of modules touches
+// a few TLB entries instead of one per 4 KB page of scattered heap.
+//
+// Each power-of-two size class keeps a lock-free Treiber stack of free blocks, so allocate()
+// and release() never take a lock. allocate() may map a new chunk and release() only pushes
+// onto a stack, but both belong on the UI or loader thread like any other engine allocation.
+// Chunks stay mapped until the pool is destroyed with the plugin.
+struct QuantumBufferPool {
+	static constexpr size_t CHUNK_SIZE = 2 << 20;
+	static constexpr int MIN_CLASS_SHIFT = 16; // 64 KB
+	static constexpr int MAX_CLASS_SHIFT = 21; // a whole chunk
+	static constexpr int CLASSES = MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1;
+	static constexpr int MAX_BLOCKS_PER_CHUNK = 1 << (MAX_CLASS_SHIFT - MIN_CLASS_SHIFT);
+	static constexpr int MAX_CHUNKS = 1024; // 2 GB
+
+	enum ChunkBacking {
+		BACKING_HUGETLB, // explicit huge pages from the reserved pool
+		BACKING_TRANSPARENT, // 2 MB aligned and advised for transparent huge pages
+		BACKING_NORMAL,
+	};
+
+	// Free stack heads pack {tag, block index + 1} so a recycled block cannot fool the CAS (ABA)
+	std::atomic<uint64_t> heads[CLASSES];
+	std::atomic<char*> chunks[MAX_CHUNKS];
+	std::atomic<uint8_t> backings[MAX_CHUNKS];
+	std::atomic<int> chunkCount{0};
+
+	QuantumBufferPool() {
+		for (int c = 0; c < CLASSES; c++)
+			heads[c].store(0, std::memory_order_relaxed);
+		for (int i = 0; i < MAX_CHUNKS; i++) {
+			chunks[i].store(nullptr, std::memory_order_relaxed);
+			backings[i].store(BACKING_NORMAL, std::memory_order_relaxed);
+		}
+	}
+
+	~QuantumBufferPool() {
+		for (int i = 0; i < MAX_CHUNKS; i++) {
+			char* chunk = chunks[i].load(std::memory_order_relaxed);
+			if (chunk)
+				unmapChunk(chunk);
+		}
+	}
+
+	// Size class for a request, or -1 if it needs more than a chunk
+	static int sizeClass(size_t bytes) {
+		for (int c = 0; c < CLASSES; c++) {
+			if (bytes <= ((size_t)1 << (MIN_CLASS_SHIFT + c)))
+				return c;
+		}
+		return -1;
+	}
+
+	// Contents are undefined. Requests larger than a chunk fall back to the heap.
+	void* allocate(size_t bytes) {
+		int c = sizeClass(bytes);
+		if (c < 0)
+			return std::malloc(bytes);
+		while (true) {
+			uint32_t index = pop(c);
+			if (index)
+				return blockAddress(c, index) + colour(index, blockSize(c) - bytes);
+			if (!grow(c))
+				return std::malloc(bytes);
+		}
+	}
+
+	// `bytes` must match the allocate() call
+	void release(void* block, size_t bytes) {
+		if (!block)
+			return;
+		int c = sizeClass(bytes);
+		uint32_t index = c < 0 ? 0 : blockIndex(c, (char*) block);
+		if (index == 0) {
+			// Heap fallback
+			std::free(block);
+			return;
+		}
+		push(c, index);
+	}
+
+	int hugeChunks() const {
+		int count = 0;
+		for (int i = 0; i < chunkCount.load(std::memory_order_acquire) && i < MAX_CHUNKS; i++)
+			count += (backings[i].load(std::memory_order_relaxed) != BACKING_NORMAL);
+		return count;
+	}
+
+private:
+	static size_t blockSize(int c) {
+		return (size_t)1 << (MIN_CLASS_SHIFT + c);
+	}
+
+	// Block indices are chunk * MAX_BLOCKS_PER_CHUNK + block + 1, 0 means none
+	char* blockAddress(int c, uint32_t index) {
+		uint32_t i = index - 1;
+		return chunks[i / MAX_BLOCKS_PER_CHUNK].load(std::memory_order_acquire) + (i % MAX_BLOCKS_PER_CHUNK) * blockSize(c);
+	}
+
+	uint32_t blockIndex(int c, char* block) {
+		int count = std::min(chunkCount.load(std::memory_order_acquire), MAX_CHUNKS);
+		for (int i = 0; i < count; i++) {
+			char* chunk = chunks[i].load(std::memory_order_acquire);
+			if (chunk && block >= chunk && block < chunk + CHUNK_SIZE)
+				return i * MAX_BLOCKS_PER_CHUNK + (uint32_t)((block - chunk) / blockSize(c)) + 1;
+		}
+		return 0;
+	}
+
+	// The link to the next free block lives in the first bytes of the free block itself
+	std::atomic<uint32_t>* link(int c, uint32_t index) {
+		return reinterpret_cast<std::atomic<uint32_t>*>(blockAddress(c, index));
+	}
+
+	void push(int c, uint32_t index) {
+		std::atomic<uint32_t>* next = new (blockAddress(c, index)) std::atomic<uint32_t>(0);
+		uint64_t head = heads[c].load(std::memory_order_relaxed);
+		uint64_t desired;
+		do {
+			next->store((uint32_t) head, std::memory_order_relaxed);
+			desired = ((head >> 32) + 1) << 32 | index;
+		} while (!heads[c].compare_exchange_weak(head, desired, std::memory_order_release, std::memory_order_relaxed));
+	}
+
+	uint32_t pop(int c) {
+		uint64_t head = heads[c].load(std::memory_order_acquire);
+		while (true) {
+			uint32_t index = (uint32_t) head;
+			if (index == 0)
+				return 0;
+			// Chunks are never unmapped while the pool lives, so a stale read here is harmless:
+			// the tag makes the CAS fail if the block was taken in the meantime
+			uint32_t next = link(c, index)->load(std::memory_order_relaxed);
+			uint64_t desired = ((head >> 32) + 1) << 32 | next;
+			if (heads[c].compare_exchange_weak(head, desired, std::memory_order_acquire, std::memory_order_acquire))
+				return index;
+		}
+	}
+
+	// Blocks of a class all start at the same offset modulo the cache's set span, and huge pages
+	// keep that true physically, so every instance's write head would land in the same sets.
+	// Spare bytes at the end of the block shift each one by a different number of cache lines.
+	static size_t colour(uint32_t index, size_t slack) {
+		size_t lines = std::min<size_t>(slack, 64 << 10) / 64;
+		return lines ? (index * 0x9e3779b1u >> 8) % lines * 64 : 0;
+	}
+
+	// Maps a chunk, splits it into blocks of class c and pushes them all
+	bool grow(int c) {
+		int slot = chunkCount.fetch_add(1, std::memory_order_acq_rel);
+		if (slot >= MAX_CHUNKS)
+			return false;
+		uint8_t backing = BACKING_NORMAL;
+		char* chunk = mapChunk(&backing);
+		if (!chunk)
+			return false;
+		backings[slot].store(backing, std::memory_order_relaxed);
+		chunks[slot].store(chunk, std::memory_order_release);
+
+		int blocks = (int)(CHUNK_SIZE / blockSize(c));
+		for (int b = blocks - 1; b >= 0; b--)
+			push(c, slot * MAX_BLOCKS_PER_CHUNK + b + 1);
+		return true;
+	}
+
+	static char* mapChunk(uint8_t* backing) {
+#ifdef _WIN32
+		*backing = BACKING_NORMAL;
+		return (char*) std::malloc(CHUNK_SIZE);
+#else
+#if defined(__linux__) && defined(MAP_HUGETLB)
+		void* huge = mmap(nullptr, CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (huge != MAP_FAILED) {
+			*backing = BACKING_HUGETLB;
+			return (char*) huge;
+		}
+#endif
+		// Over-map and trim to a 2 MB boundary so the chunk can be promoted to a huge page
+		void* raw = mmap(nullptr, CHUNK_SIZE * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (raw == MAP_FAILED)
+			return nullptr;
+		uintptr_t start = (uintptr_t) raw;
+		uintptr_t aligned = (start + CHUNK_SIZE - 1) & ~(uintptr_t)(CHUNK_SIZE - 1);
+		if (aligned > start)
+			munmap(raw, aligned - start);
+		if (aligned + CHUNK_SIZE < start + CHUNK_SIZE * 2)
+			munmap((void*)(aligned + CHUNK_SIZE), start + CHUNK_SIZE * 2 - aligned - CHUNK_SIZE);
+		*backing = BACKING_NORMAL;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+		if (madvise((void*) aligned, CHUNK_SIZE, MADV_HUGEPAGE) == 0)
+			*backing = BACKING_TRANSPARENT;
+#endif
+		return (char*) aligned;
+#endif
+	}
+
+	static void unmapChunk(char* chunk) {
+#ifdef _WIN32
+		std::free(chunk);
+#else
+		munmap(chunk, CHUNK_SIZE);
+#endif
+	}
+};
+
+// The plugin-wide instance
+QuantumBufferPool& quantumBufferPool();
@@ -0,0 +1,318 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "QuantumSpscRing.hpp"
+#include "QuantumSuperpositionEngine.hpp"
+
+// Runs a heavy engine on its own worker thread. The audio thread pushes blocks of input,
+// with the controls and collapses that belong to them, and reads the rendered blocks back
+// a fixed latency later. A block that is not back in time is replaced by the dry input of
+// the same frames and counted, so the latency never moves; the late block is skipped.
+//
+// The audio thread never blocks or makes a system call: the worker polls the input ring and
+// is only signalled by the UI thread, to stop.
+//
+// Per-tap outputs are held at zero and expander banks are muted while offloaded, as their reads
+// would race the worker. The profiler is not handed on either: it takes one writing thread,
+// so only the module's own stages are timed. Built and destroyed on the UI thread like any
+// other engine.
+struct QuantumOffloadEngine : QuantumEngineBase {
+	static constexpr int BLOCK = 64;
+	static constexpr int RING_BLOCKS = 64; // 4096 frames in flight either way
+	static constexpr int MAX_LATENCY = BLOCK * (RING_BLOCKS / 2);
+	// Well under a block at any host rate, so the worker finds each block soon after it lands
+	static constexpr int POLL_MICROSECONDS = 250;
+
+	struct InputBlock {
+		uint32_t sequence;
+		uint8_t collapses[BLOCK]; // landing before each frame, so they keep their timing
+		QuantumHistory* history; // installed by the worker before the block
+		QuantumControls controls;
+		float inL[BLOCK];
+		float inR[BLOCK];
+		float bankL[BLOCK];
+		float bankR[BLOCK];
+	};
+
+	struct OutputBlock {
+		uint32_t sequence;
+		float outL[BLOCK];
+		float outR[BLOCK];
+	};
+
+	QuantumEngineBase* inner;
+	int latency; // frames, a multiple of BLOCK
+
+	QuantumSpscRing<InputBlock, RING_BLOCKS> inputs;
+	QuantumSpscRing<OutputBlock, RING_BLOCKS> outputs;
+
+	// Audio thread
+	InputBlock spare; // filled and thrown away while the input ring is full
+	InputBlock* filling = nullptr;
+	int fillPosition = 0;
+	uint32_t sequence = 0;
+	int primingFrames = 0;
+	uint32_t outputSequence = 0; // block due at the output
+	int outputOffset = 0;
+	int pendingCollapses = 0;
+	QuantumHistory* pendingHistory = nullptr;
+	// Input of the last MAX_LATENCY + BLOCK frames, the fallback for late blocks
+	std::vector<float> dryL;
+	std::vector<float> dryR;
+	int dryIndex = 0;
+
+	// Written by the audio thread or the worker, read anywhere
+	std::atomic<uint32_t> lateFrames{0}; // frames replaced by the dry input
+	std::atomic<uint32_t> droppedBlocks{0}; // blocks lost to a full ring
+	std::atomic<int> innerLatency{0};
+	std::atomic<int> innerMixLatency{0};
+	// Handed back by the worker's swaps, collected by the next swapHistory()
+	std::atomic<QuantumHistory*> replacedHistory{nullptr};
+
+	std::thread worker;
+	// Shutdown only, see workerLoop()
+	std::mutex wakeMutex;
+	std::condition_variable wake;
+	std::atomic<bool> running{true};
+
+	QuantumOffloadEngine(QuantumEngineBase* inner, int latencyFrames) : inner(inner) {
+		latency = clamp((latencyFrames + BLOCK - 1) / BLOCK * BLOCK, BLOCK, MAX_LATENCY);
+		controls = inner->controls;
+		primingFrames = latency;
+		dryL.assign(MAX_LATENCY + BLOCK, 0.f);
+		dryR.assign(MAX_LATENCY + BLOCK, 0.f);
+		worker = std::thread(&QuantumOffloadEngine::workerLoop, this);
+	}
+
+	~QuantumOffloadEngine() {
+		running.store(false);
+		wake.notify_one();
+		worker.join();
+		// Histories still in flight never reached the worker
+		while (InputBlock* in = inputs.front()) {
+			delete in->history;
+			inputs.pop();
+		}
+		delete pendingHistory;
+		delete replacedHistory.load();
+		delete inner;
+	}
+
+	int getTapCount() override {
+		return inner->getTapCount();
+	}
+
+	int getInterpolation() override {
+		return inner->getInterpolation();
+	}
+
+	int getSampleFormat() override {
+		return inner->getSampleFormat();
+	}
+
+	// Display only: the worker moves these while they are read
+	float* getProbWeights() override {
+		return inner->getProbWeights();
+	}
+
+	float* getTargetWeights() override {
+		return inner->getTargetWeights();
+	}
+
+	// Before the first frame only
+	void seed(uint32_t seed) override {
+		inner->seed(seed);
+	}
+
+	void reset() override {
+		inner->reset();
+	}
+
+	// Applied by the worker just before the frame that follows
+	void collapse() override {
+		pendingCollapses++;
+	}
+
+	int getLatency() override {
+		return latency + innerLatency.load(std::memory_order_relaxed);
+	}
+
+	int getMixLatency() override {
+		return latency + innerMixLatency.load(std::memory_order_relaxed);
+	}
+
+	void fillBankMessage(QuantumBankMessage* message) override {
+		inner->fillBankMessage(message);
+		for (int i = 0; i < QUANTUM_MAX_BANKS * QUANTUM_BANK_TAPS; i++)
+			message->weights[i] = 0.f;
+		for (int g = 0; g < QUANTUM_MAX_BANKS * QUANTUM_BANK_TAPS / 2; g++)
+			message->mixGains[g] = 0.f;
+	}
+
+	void setTape(QuantumTape* tape) override {
+		inner->setTape(tape);
+	}
+
+	QuantumTape* getTape() override {
+		return inner->getTape();
+	}
+
+	int getHistoryFrames() override {
+		return inner->getHistoryFrames();
+	}
+
+	QuantumHistory* buildHistory(const QuantumHistorySource& source) override {
+		return inner->buildHistory(source);
+	}
+
+	// Travels with the next block, so the worker swaps between two blocks. What it replaces
+	// comes back through a later call; a history superseded before it left comes back first.
+	QuantumHistory* swapHistory(QuantumHistory* history) override {
+		QuantumHistory* superseded = nullptr;
+		if (history) {
+			superseded = pendingHistory;
+			pendingHistory = history;
+		}
+		if (superseded)
+			return superseded;
+		return replacedHistory.exchange(nullptr, std::memory_order_acquire);
+	}
+
+	// The inner engine publishes it atomically, the worker takes it up at a control tick
+	void prepareSpectral() override {
+		inner->prepareSpectral();
+	}
+
+	void processFrame(QuantumFrame& frame) override {
+		// The worker's tap reads never come back, so the channels must not keep old voltages
+		if (frame.taps)
+			std::fill(frame.taps, frame.taps + 16, 0.f);
+
+		// Input side
+		if (!filling) {
+			filling = inputs.back();
+			if (!filling) {
+				droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+				filling = &spare;
+			}
+		}
+		filling->collapses[fillPosition] = (uint8_t) std::min(pendingCollapses, 255);
+		pendingCollapses = 0;
+		filling->inL[fillPosition] = frame.inL;
+		filling->inR[fillPosition] = frame.inR;
+		filling->bankL[fillPosition] = frame.bankL;
+		filling->bankR[fillPosition] = frame.bankR;
+		int dryFrames = (int) dryL.size();
+		dryL[dryIndex] = frame.inL;
+		dryR[dryIndex] = frame.inR;
+		dryIndex = (dryIndex + 1 == dryFrames) ? 0 : dryIndex + 1;
+
+		if (++fillPosition == BLOCK) {
+			filling->sequence = sequence++;
+			filling->controls = controls;
+			filling->history = nullptr;
+			if (filling != &spare) {
+				std::swap(filling->history, pendingHistory);
+				inputs.push();
+			}
+			filling = nullptr;
+			fillPosition = 0;
+		}
+
+		// Output side: the rendered frame pushed `latency` frames ago is due
+		if (primingFrames > 0) {
+			primingFrames--;
+			frame.outL = 0.f;
+			frame.outR = 0.f;
+			return;
+		}
+		uint32_t dueBlock = outputSequence;
+		int offset = outputOffset;
+		if (++outputOffset == BLOCK) {
+			outputOffset = 0;
+			outputSequence++;
+		}
+		OutputBlock* block = outputs.front();
+		// Skip blocks whose frames were already covered by the fallback
+		while (block && (int32_t)(block->sequence - dueBlock) < 0) {
+			outputs.pop();
+			block = outputs.front();
+		}
+		if (block && block->sequence == dueBlock) {
+			frame.outL = block->outL[offset];
+			frame.outR = block->outR[offset];
+			if (offset == BLOCK - 1)
+				outputs.pop();
+		} else {
+			int dry = dryIndex - 1 - latency;
+			if (dry < 0)
+				dry += dryFrames;
+			frame.outL = dryL[dry];
+			frame.outR = dryR[dry];
+			lateFrames.fetch_add(1, std::memory_order_relaxed);
+		}
+	}
+
+	void processBlock(const float* inL, const float* inR, float* outL, float* outR, int frames) override {
+		QuantumFrame frame;
+		for (int i = 0; i < frames; i++) {
+			frame.inL = inL[i];
+			frame.inR = inR ? inR[i] : inL[i];
+			processFrame(frame);
+			outL[i] = frame.outL;
+			if (outR)
+				outR[i] = frame.outR;
+		}
+	}
+
+	void workerLoop() {
+		OutputBlock discard;
+		while (running.load(std::memory_order_relaxed)) {
+			InputBlock* in = inputs.front();
+			if (!in) {
+				std::unique_lock<std::mutex> lock(wakeMutex);
+				// Polled: notifying from the audio thread could enter the kernel
+				wake.wait_for(lock, std::chrono::microseconds(POLL_MICROSECONDS));
+				continue;
+			}
+
+			inner->controls = in->controls;
+			if (in->history) {
+				// One the audio thread has not collected yet is freed here, off the audio thread
+				QuantumHistory* replaced = inner->swapHistory(in->history);
+				delete replacedHistory.exchange(replaced, std::memory_order_acq_rel);
+				in->history = nullptr;
+			}
+
+			OutputBlock* out = outputs.back();
+			if (!out) {
+				// The audio thread stopped reading, keep the engine running regardless
+				droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+				out = &discard;
+			}
+			QuantumFrame frame;
+			for (int i = 0; i < BLOCK; i++) {
+				for (int c = 0; c < in->collapses[i]; c++)
+					inner->collapse();
+				frame.inL = in->inL[i];
+				frame.inR = in->inR[i];
+				frame.bankL = in->bankL[i];
+				frame.bankR = in->bankR[i];
+				inner->processFrame(frame);
+				out->outL[i] = frame.outL;
+				out->outR[i] = frame.outR;
+			}
+			out->sequence = in->sequence;
+			innerLatency.store(inner->getLatency(), std::memory_order_relaxed);
+			innerMixLatency.store(inner->getMixLatency(), std::memory_order_relaxed);
+			if (out != &discard)
+				outputs.push();
+			inputs.pop();
+		}
+	}
+};
@@ -0,0 +1,259 @@
+#pragma once
+#include "QuantumSuperpositionEngine.hpp"
+
+// Linear-phase halfband lowpass for 2x resampling, in polyphase form, four channels per
+// vector. Every other tap of a halfband is zero and the centre tap is 1/2, so a 2x step only
+// convolves the COEFFS odd-offset taps and the other phase is a plain delay.
+// The interpolator delays by COEFFS - 1 frames of the higher rate and the decimator by one
+// less, as its output lines up with the second of its two input frames.
+template <int COEFFS>
+struct QuantumHalfband4 {
+	static_assert(COEFFS % 2 == 0, "halfband branches are symmetric");
+
+	float coeffs[COEFFS];
+	// Input of the convolved phase, written twice so COEFFS frames are always contiguous
+	float_4 history[2 * COEFFS];
+	// Even frames of the downsampler, which only need delaying
+	float_4 delayed[2 * COEFFS];
+	int position = 0;
+
+	// Kaiser-windowed sinc, beta trades stopband rejection against transition width
+	explicit QuantumHalfband4(float beta) {
+		float sum = 0.f;
+		for (int i = 0; i < COEFFS; i++) {
+			int k = 2 * i - (COEFFS - 1); // odd offset from the centre tap
+			float r = k / (float) COEFFS;
+			float window = besselI0(beta * std::sqrt(1.f - r * r)) / besselI0(beta);
+			coeffs[i] = std::sin(M_PI * k / 2) / (M_PI * k) * window;
+			sum += coeffs[i];
+		}
+		// Unity gain at DC: the branch sums to 1/2, like the centre tap
+		for (int i = 0; i < COEFFS; i++)
+			coeffs[i] *= 0.5f / sum;
+		reset();
+	}
+
+	static float besselI0(float x) {
+		float sum = 1.f;
+		float term = 1.f;
+		for (int k = 1; k < 32; k++) {
+			term *= (x / (2.f * k)) * (x / (2.f * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	void reset() {
+		for (int i = 0; i < 2 * COEFFS; i++) {
+			history[i] = 0.f;
+			delayed[i] = 0.f;
+		}
+		position = 0;
+	}
+
+	void push(float_4* line, float_4 x) {
+		line[position] = x;
+		line[position + COEFFS] = x;
+	}
+
+	void advance() {
+		position = (position == 0) ? COEFFS - 1 : position - 1;
+	}
+
+	// Newest frame first, so the window reads forwards
+	float_4 convolve() {
+		const float_4* window = &history[position];
+		float_4 sum = 0.f;
+		for (int i = 0; i < COEFFS; i++)
+			sum += window[i] * coeffs[i];
+		return sum;
+	}
+
+	// One frame in, two frames out at twice the rate
+	void upsample(float_4 x, float_4* out) {
+		advance();
+		push(history, x);
+		out[0] = 2.f * convolve();
+		out[1] = history[position + COEFFS / 2 - 1];
+	}
+
+	// Two frames in at twice the rate, one frame out
+	float_4 downsample(float_4 even, float_4 odd) {
+		advance();
+		push(history, odd);
+		push(delayed, even);
+		return convolve() + 0.5f * delayed[position + COEFFS / 2 - 1];
+	}
+};
+
+// Runs an engine at 2x or 4x the host rate, so chaos-jittered reads and the feedback
+// nonlinearities alias above the audible band where the decimator removes them. Input and
+// expander returns go up through halfband interpolators and the output comes down through
+// the mirrored decimators, one 2x stage at a time; the second stage only has to protect the
+// band the first one kept, so it is shorter.
+//
+// The inner engine is built with `factor` times the history and control interval, so delay
+// ranges and control-rate motion match the plain engine. Per-tap outputs and expander banks
+// see the inner rate, undecimated.
+struct QuantumOversampledEngine : QuantumEngineBase {
+	// Host <-> 2x: flat to 0.375 of the host rate, 80 dB down from 0.625, 23 frames each way
+	static constexpr int OUTER_COEFFS = 24;
+	// 2x <-> 4x: 60 dB over the images of the band the outer stage keeps
+	static constexpr int INNER_COEFFS = 8;
+	static constexpr float INPUT_LIMIT = 100.f;
+
+	QuantumEngineBase* inner;
+	int factor; // 2 or 4
+
+	// Lanes {in L, in R, bank L, bank R} going up, {out L, out R, 0, 0} coming down
+	QuantumHalfband4<OUTER_COEFFS> outerUp{8.f};
+	QuantumHalfband4<OUTER_COEFFS> outerDown{8.f};
+	QuantumHalfband4<INNER_COEFFS> innerUp{6.f};
+	QuantumHalfband4<INNER_COEFFS> innerDown{6.f};
+
+	QuantumOversampledEngine(QuantumEngineBase* inner, int factor) : inner(inner), factor(factor >= 4 ? 4 : 2) {
+		controls = inner->controls;
+	}
+
+	~QuantumOversampledEngine() {
+		delete inner;
+	}
+
+	int getTapCount() override {
+		return inner->getTapCount();
+	}
+
+	int getInterpolation() override {
+		return inner->getInterpolation();
+	}
+
+	int getSampleFormat() override {
+		return inner->getSampleFormat();
+	}
+
+	float* getProbWeights() override {
+		return inner->getProbWeights();
+	}
+
+	float* getTargetWeights() override {
+		return inner->getTargetWeights();
+	}
+
+	void seed(uint32_t seed) override {
+		inner->seed(seed);
+	}
+
+	void reset() override {
+		inner->reset();
+		outerUp.reset();
+		outerDown.reset();
+		innerUp.reset();
+		innerDown.reset();
+	}
+
+	// Lands on the first inner frame of the next host frame
+	void collapse() override {
+		inner->collapse();
+	}
+
+	// Host frames, rounded. The outer pair delays by 2 * (OUTER_COEFFS - 1) frames of the 2x rate
+	// less the one the decimator's phase takes off, the inner pair by 2 * (INNER_COEFFS - 1)
+	// frames of the 4x rate.
+	int getLatency() override {
+		int quarterFrames = (2 * (OUTER_COEFFS - 1) - 1) * 2 + (factor == 4 ? 2 * (INNER_COEFFS - 1) : 0);
+		return (quarterFrames + 2) / 4 + inner->getLatency() / factor;
+	}
+
+	// The decimators alone: OUTER_COEFFS - 2 frames of the 2x rate, INNER_COEFFS - 2 of the 4x
+	int getMixLatency() override {
+		int quarterFrames = (OUTER_COEFFS - 2) * 2 + (factor == 4 ? INNER_COEFFS - 2 : 0);
+		return (quarterFrames + 2) / 4 + inner->getMixLatency() / factor;
+	}
+
+	// Bank audio comes back through the upsamplers, the taps' history has been through them once
+	// already: OUTER_COEFFS - 1 frames of the 2x rate, INNER_COEFFS of the 4x
+	void fillBankMessage(QuantumBankMessage* message) override {
+		inner->fillBankMessage(message);
+		message->returnDelay += (factor == 4) ? 2 * (OUTER_COEFFS - 1) + INNER_COEFFS : OUTER_COEFFS - 1;
+	}
+
+	void setTape(QuantumTape* tape) override {
+		inner->setTape(tape);
+	}
+
+	QuantumTape* getTape() override {
+		return inner->getTape();
+	}
+
+	int getHistoryFrames() override {
+		return inner->getHistoryFrames();
+	}
+
+	QuantumHistory* buildHistory(const QuantumHistorySource& source) override {
+		return inner->buildHistory(source);
+	}
+
+	QuantumHistory* swapHistory(QuantumHistory* history) override {
+		return inner->swapHistory(history);
+	}
+
+	void prepareSpectral() override {
+		inner->prepareSpectral();
+	}
+
+	void processFrame(QuantumFrame& frame) override {
+		inner->controls = controls;
+		inner->controls.sampleRate = controls.sampleRate * factor;
+
+		// Sanitised here as the inner engine would, a NaN would stay in the filter history
+		float_4 x(frame.inL, frame.inR, frame.bankL, frame.bankR);
+		x = simd::ifelse(x == x, simd::clamp(x, -INPUT_LIMIT, INPUT_LIMIT), 0.f);
+		float_4 up[4];
+		outerUp.upsample(x, up);
+		if (factor == 4) {
+			float_4 half[2] = {up[0], up[1]};
+			innerUp.upsample(half[0], &up[0]);
+			innerUp.upsample(half[1], &up[2]);
+		}
+
+		float_4 out[4];
+		QuantumFrame sub;
+		sub.stereoTaps = frame.stereoTaps;
+		for (int i = 0; i < factor; i++) {
+			sub.inL = up[i][0];
+			sub.inR = up[i][1];
+			sub.bankL = up[i][2];
+			sub.bankR = up[i][3];
+			// Tap outputs are sampled once per host frame
+			sub.taps = (i == factor - 1) ? frame.taps : nullptr;
+			inner->processFrame(sub);
+			out[i] = float_4(sub.outL, sub.outR, 0.f, 0.f);
+		}
+
+		if (factor == 4) {
+			out[0] = innerDown.downsample(out[0], out[1]);
+			out[1] = innerDown.downsample(out[2], out[3]);
+		}
+		// The filters overshoot a hostile step, so the plain engine's bound is applied again
+		float_4 y = simd::clamp(outerDown.downsample(out[0], out[1]), -INPUT_LIMIT, INPUT_LIMIT);
+		frame.outL = y[0];
+		frame.outR = y[1];
+		faultRecoveries = inner->faultRecoveries;
+#ifdef QSD_PROFILE
+		// Set on the wrapper after construction, the stages are timed inside
+		inner->profiler = profiler;
+#endif
+	}
+
+	void processBlock(const float* inL, const float* inR, float* outL, float* outR, int frames) override {
+		QuantumFrame frame;
+		for (int i = 0; i < frames; i++) {
+			frame.inL = inL[i];
+			frame.inR = inR ? inR[i] : inL[i];
+			processFrame(frame);
+			outL[i] = frame.outL;
+			if (outR)
+				outR[i] = frame.outR;
+		}
+	}
+};
@@ -0,0 +1,159 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Optional per-stage cycle counters for the audio path. Build with -DQSD_PROFILE to enable;
+// otherwise QUANTUM_PROFILE_SCOPE expands to nothing and the audio thread is untouched.
+
+enum QuantumProfileStage {
+	PROFILE_CONTROLS,
+	PROFILE_WEIGHTS,
+	PROFILE_DELAY_TIMES,
+	PROFILE_TAP_GAINS,
+	PROFILE_TAP_LOOP,
+	PROFILE_ENTANGLEMENT,
+	PROFILE_GRAINS,
+	PROFILE_SPECTRAL,
+	PROFILE_OUTPUT,
+	PROFILE_LIGHTS,
+	PROFILE_STAGES_LEN
+};
+
+static const char* const QUANTUM_PROFILE_STAGE_NAMES[PROFILE_STAGES_LEN] = {
+	"Controls",
+	"Probability weights",
+	"Delay times",
+	"Tap gains",
+	"Tap loop",
+	"Entanglement writes",
+	"Grains",
+	"Spectral frames",
+	"Output mix",
+	"Lights",
+};
+
+// Time stamp counter, or the closest thing the platform has
+inline uint64_t quantumCycles() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#elif defined(__aarch64__)
+	uint64_t ticks;
+	asm volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+	return ticks;
+#else
+	return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Log2 histogram of cycles per call for each stage.
+// Only the audio thread writes, so relaxed load/store pairs replace locked increments;
+// the UI thread may read at any time and sees slightly stale but never torn counts.
+struct QuantumProfiler {
+	static constexpr int BINS = 32;
+
+	std::atomic<uint32_t> histogram[PROFILE_STAGES_LEN][BINS];
+	std::atomic<uint64_t> cycles[PROFILE_STAGES_LEN];
+	std::atomic<uint64_t> calls[PROFILE_STAGES_LEN];
+	std::atomic<bool> resetRequested{false};
+
+	struct Summary {
+		uint64_t calls = 0;
+		double mean = 0.0;
+		uint64_t p50 = 0; // upper bound of the histogram bin
+		uint64_t p99 = 0;
+		double share = 0.0; // of all profiled cycles
+	};
+
+	QuantumProfiler() {
+		clear();
+	}
+
+	template <typename T>
+	static void bump(std::atomic<T>& counter, T amount) {
+		counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+	}
+
+	// Audio thread
+	void clear() {
+		for (int s = 0; s < PROFILE_STAGES_LEN; s++) {
+			for (int b = 0; b < BINS; b++)
+				histogram[s][b].store(0, std::memory_order_relaxed);
+			cycles[s].store(0, std::memory_order_relaxed);
+			calls[s].store(0, std::memory_order_relaxed);
+		}
+	}
+
+	// Audio thread
+	void record(int stage, uint64_t elapsed) {
+		int bin = elapsed ? std::min(63 - __builtin_clzll(elapsed), BINS - 1) : 0;
+		bump<uint32_t>(histogram[stage][bin], 1);
+		bump<uint64_t>(cycles[stage], elapsed);
+		bump<uint64_t>(calls[stage], 1);
+	}
+
+	// Audio thread, once per control block: honours a reset requested from the UI
+	void poll() {
+		if (resetRequested.load(std::memory_order_relaxed)) {
+			clear();
+			resetRequested.store(false, std::memory_order_relaxed);
+		}
+	}
+
+	// UI thread
+	Summary summarize(int stage) const {
+		Summary summary;
+		uint64_t total = 0;
+		for (int s = 0; s < PROFILE_STAGES_LEN; s++)
+			total += cycles[s].load(std::memory_order_relaxed);
+
+		uint32_t counts[BINS];
+		uint64_t binTotal = 0;
+		for (int b = 0; b < BINS; b++) {
+			counts[b] = histogram[stage][b].load(std::memory_order_relaxed);
+			binTotal += counts[b];
+		}
+
+		summary.calls = calls[stage].load(std::memory_order_relaxed);
+		if (summary.calls > 0)
+			summary.mean = (double)cycles[stage].load(std::memory_order_relaxed) / summary.calls;
+		if (total > 0)
+			summary.share = (double)cycles[stage].load(std::memory_order_relaxed) / total;
+
+		uint64_t seen = 0;
+		for (int b = 0; b < BINS; b++) {
+			seen += counts[b];
+			if (summary.p50 == 0 && seen * 2 >= binTotal && binTotal > 0)
+				summary.p50 = 2ull << b;
+			if (summary.p99 == 0 && seen * 100 >= binTotal * 99 && binTotal > 0)
+				summary.p99 = 2ull << b;
+		}
+		return summary;
+	}
+};
+
+struct QuantumProfileScope {
+	QuantumProfiler* profiler;
+	int stage;
+	uint64_t start;
+
+	QuantumProfileScope(QuantumProfiler* profiler, int stage) : profiler(profiler), stage(stage), start(quantumCycles()) {}
+	~QuantumProfileScope() {
+		if (profiler)
+			profiler->record(stage, quantumCycles() - start);
+	}
+};
+
+#ifdef QSD_PROFILE
+#define QUANTUM_PROFILE_CONCAT_(a, b) a##b
+#define QUANTUM_PROFILE_CONCAT(a, b) QUANTUM_PROFILE_CONCAT_(a, b)
+// Times from here to the end of the enclosing scope
+#define QUANTUM_PROFILE_SCOPE(profiler, stage) QuantumProfileScope QUANTUM_PROFILE_CONCAT(profileScope, __LINE__)(profiler, stage)
+#else
+#define QUANTUM_PROFILE_SCOPE(profiler, stage)
+#endif
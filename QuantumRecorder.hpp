@@ -0,0 +1,193 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "QuantumSpscRing.hpp"
+#include "QuantumWav.hpp"
+
+// Streams the module's output, and optionally its per-tap channels, to 32-bit float WAV.
+// The audio thread only copies frames into blocks of a lock-free ring; a writer thread
+// drains the ring to disk, so nothing on the audio thread allocates or waits on the file.
+// A block that finds the ring full is dropped and counted, and the take skips those frames.
+// Takes roll over to path_2.wav, path_3.wav... before the 4 GiB RIFF limit.
+//
+// start() and stop() belong to the UI thread, active() and record() to the audio thread.
+// Each take is a session: an odd session number is recording, and a block carries the
+// session it was filled in, so blocks of an earlier take are never written into a later one.
+struct QuantumRecorder {
+	static constexpr int BLOCK = 256;
+	static constexpr int RING_BLOCKS = 256; // 1.4 s at 48 kHz
+	static constexpr int MAX_CHANNELS = 2 + 16;
+	static constexpr int WRITER_SLEEP_MS = 10;
+	static constexpr uint64_t MAX_DATA_BYTES = 0xffffffffu - 36;
+
+	struct Block {
+		uint32_t session;
+		int channels;
+		int frames;
+		float samples[BLOCK * MAX_CHANNELS];
+	};
+
+	// Allocated by the first start() and kept, so a block in flight always has somewhere to land
+	std::unique_ptr<QuantumSpscRing<Block, RING_BLOCKS>> ring;
+	std::atomic<uint32_t> session{0};
+	std::atomic<int> sessionChannels{2};
+	// Last session the audio thread has switched to
+	std::atomic<uint32_t> acknowledged{0};
+
+	// Audio thread
+	uint32_t blockSession = 0;
+	int blockChannels = 2;
+	Block* filling = nullptr;
+	int fillPosition = 0;
+	Block spare; // filled and thrown away while the ring is full
+
+	// Written by either thread, read anywhere
+	std::atomic<uint32_t> droppedBlocks{0};
+	std::atomic<int64_t> recordedFrames{0};
+	std::atomic<bool> failed{false};
+
+	// UI and writer thread
+	std::string path;
+	int channels = 2;
+	int sampleRate = 48000;
+	int part = 1;
+	WavWriter writer;
+	std::thread writerThread;
+	std::atomic<bool> running{false};
+
+	~QuantumRecorder() {
+		stop();
+	}
+
+	bool isRecording() const {
+		return session.load(std::memory_order_relaxed) & 1;
+	}
+
+	// `channels` includes the two output channels
+	bool start(const std::string& newPath, int newChannels, int newSampleRate, std::string* error) {
+		stop();
+		if (!ring)
+			ring.reset(new QuantumSpscRing<Block, RING_BLOCKS>);
+		channels = std::min(std::max(newChannels, 1), MAX_CHANNELS);
+		sampleRate = newSampleRate;
+		path = newPath;
+		part = 1;
+		if (!writer.open(path, channels, sampleRate, error))
+			return false;
+		droppedBlocks.store(0);
+		recordedFrames.store(0);
+		failed.store(false);
+
+		uint32_t take = session.load(std::memory_order_relaxed) + 1;
+		running.store(true);
+		writerThread = std::thread(&QuantumRecorder::writerLoop, this, take);
+		sessionChannels.store(channels, std::memory_order_relaxed);
+		session.store(take, std::memory_order_release);
+		return true;
+	}
+
+	void stop() {
+		uint32_t take = session.load(std::memory_order_relaxed);
+		if (!(take & 1))
+			return;
+		session.store(take + 1, std::memory_order_release);
+		// Give the audio thread a moment to hand over its last partial block
+		for (int i = 0; i < 50 && acknowledged.load(std::memory_order_acquire) != take + 1; i++)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		running.store(false, std::memory_order_release);
+		writerThread.join();
+		if (!writer.close())
+			failed.store(true);
+	}
+
+	// Audio thread: whether record() wants this frame, either for the take or to finish one
+	bool active() const {
+		return session.load(std::memory_order_relaxed) != blockSession || (blockSession & 1);
+	}
+
+	// Audio thread: one frame of the take's channels, the rest of `samples` is ignored
+	void record(const float* samples) {
+		uint32_t take = session.load(std::memory_order_acquire);
+		if (take != blockSession) {
+			if (filling)
+				publish();
+			blockSession = take;
+			blockChannels = sessionChannels.load(std::memory_order_relaxed);
+			acknowledged.store(take, std::memory_order_release);
+		}
+		if (!(take & 1))
+			return;
+
+		if (!filling) {
+			filling = ring->back();
+			if (!filling) {
+				droppedBlocks.fetch_add(1, std::memory_order_relaxed);
+				filling = &spare;
+			}
+		}
+		std::memcpy(&filling->samples[fillPosition * blockChannels], samples, blockChannels * sizeof(float));
+		if (++fillPosition == BLOCK)
+			publish();
+	}
+
+	void publish() {
+		filling->session = blockSession;
+		filling->channels = blockChannels;
+		filling->frames = fillPosition;
+		if (filling != &spare)
+			ring->push();
+		filling = nullptr;
+		fillPosition = 0;
+	}
+
+	// Drains the ring until stopped and empty, writing the blocks of its own take
+	void writerLoop(uint32_t take) {
+		while (true) {
+			Block* block = ring->front();
+			if (!block) {
+				if (!running.load(std::memory_order_acquire))
+					break;
+				std::this_thread::sleep_for(std::chrono::milliseconds(WRITER_SLEEP_MS));
+				continue;
+			}
+			if (block->session == take && block->channels == channels)
+				writeBlock(block);
+			ring->pop();
+		}
+	}
+
+	void writeBlock(const Block* block) {
+		// A failed take keeps draining, so the audio thread never sees a full ring for it
+		if (failed.load(std::memory_order_relaxed))
+			return;
+		if ((uint64_t)(writer.frames + block->frames) * channels * 4 > MAX_DATA_BYTES) {
+			std::string error;
+			part++;
+			bool ok = writer.close();
+			ok = ok && writer.open(partPath(part), channels, sampleRate, &error);
+			if (!ok) {
+				failed.store(true);
+				return;
+			}
+		}
+		if (!writer.writeInterleaved(block->samples, block->frames)) {
+			failed.store(true);
+			return;
+		}
+		recordedFrames.fetch_add(block->frames, std::memory_order_relaxed);
+	}
+
+	std::string partPath(int n) const {
+		size_t dot = path.rfind('.');
+		size_t slash = path.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			dot = path.size();
+		return path.substr(0, dot) + "_" + std::to_string(n) + path.substr(dot);
+	}
+};
@@ -0,0 +1,458 @@
+#pragma once
+#include <rack.hpp>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#include "QuantumBufferPool.hpp"
+
+using namespace rack;
+using simd::float_4;
+
+// Spectral mode: 1024-point frames every 256 frames (75% overlap)
+static constexpr int QUANTUM_SPECTRAL_SIZE = 1024;
+static constexpr int QUANTUM_SPECTRAL_HOP = 256;
+static constexpr int QUANTUM_SPECTRAL_BINS = QUANTUM_SPECTRAL_SIZE / 2 + 1;
+// Bin arrays are padded to whole vectors, the padding stays zero
+static constexpr int QUANTUM_SPECTRAL_STRIDE = (QUANTUM_SPECTRAL_BINS + 3) / 4 * 4;
+// Frames of spectral history, a power of two covering a plain engine's longest tap delay
+static constexpr int QUANTUM_SPECTRAL_FRAMES = 64;
+// Longest tap delay spectral mode follows, in frames at the engine's rate. Taps reaching
+// further, as they do under oversampling and on tape, are held at it.
+static constexpr int QUANTUM_SPECTRAL_MAX_DELAY = QUANTUM_SPECTRAL_SIZE + (QUANTUM_SPECTRAL_FRAMES - 1) * QUANTUM_SPECTRAL_HOP;
+
+// Bump allocator over a single block. layout() functions run twice: first against an
+// arena without memory to measure, then against the real block to hand out pointers.
+struct QuantumArena {
+	static constexpr size_t ALIGN = 64;
+
+	char* base = nullptr;
+	size_t used = 0;
+
+	template <typename T>
+	T* take(size_t count) {
+		size_t offset = (used + ALIGN - 1) & ~(ALIGN - 1);
+		used = offset + sizeof(T) * count;
+		return base ? reinterpret_cast<T*>(base + offset) : nullptr;
+	}
+};
+
+// Real FFT of a power-of-two size N, computed as an N/2-point complex FFT on split real and
+// imaginary arrays. Bit reversal and the twiddles of every stage are planned up front, so a
+// transform is table reads and float_4 butterflies.
+struct QuantumRealFFT {
+	int size = 0;
+	int half = 0;
+	int32_t* bitReverse = nullptr; // [half]
+	// Stages with a span of 4 and up, span s stored at offset s - 4
+	float* twiddleRe = nullptr;
+	float* twiddleIm = nullptr;
+	// exp(-2 pi i k / N) for the real/complex split, [half]
+	float* splitRe = nullptr;
+	float* splitIm = nullptr;
+	float* workRe = nullptr; // [half]
+	float* workIm = nullptr;
+
+	void layout(QuantumArena& arena, int n) {
+		size = n;
+		half = n / 2;
+		bitReverse = arena.take<int32_t>(half);
+		twiddleRe = arena.take<float>(half);
+		twiddleIm = arena.take<float>(half);
+		splitRe = arena.take<float>(half);
+		splitIm = arena.take<float>(half);
+		workRe = arena.take<float>(half);
+		workIm = arena.take<float>(half);
+	}
+
+	// Fills the tables once the arena has memory
+	void plan() {
+		int bits = 0;
+		while ((1 << bits) < half)
+			bits++;
+		for (int i = 0; i < half; i++) {
+			int r = 0;
+			for (int b = 0; b < bits; b++)
+				r |= ((i >> b) & 1) << (bits - 1 - b);
+			bitReverse[i] = r;
+		}
+		for (int span = 4; span < half; span *= 2) {
+			for (int j = 0; j < span; j++) {
+				double phase = -M_PI * j / span;
+				twiddleRe[span - 4 + j] = std::cos(phase);
+				twiddleIm[span - 4 + j] = std::sin(phase);
+			}
+		}
+		for (int k = 0; k < half; k++) {
+			double phase = -2.0 * M_PI * k / size;
+			splitRe[k] = std::cos(phase);
+			splitIm[k] = std::sin(phase);
+		}
+	}
+
+	// In-place complex FFT of bit-reversed input, forward direction
+	void transform(float* re, float* im) {
+		for (int i = 0; i < half; i += 2) {
+			float ar = re[i], ai = im[i];
+			float br = re[i + 1], bi = im[i + 1];
+			re[i] = ar + br;
+			im[i] = ai + bi;
+			re[i + 1] = ar - br;
+			im[i + 1] = ai - bi;
+		}
+		// Span 2, twiddles 1 and -i
+		for (int i = 0; i < half; i += 4) {
+			float ar = re[i], ai = im[i];
+			float br = re[i + 2], bi = im[i + 2];
+			re[i] = ar + br;
+			im[i] = ai + bi;
+			re[i + 2] = ar - br;
+			im[i + 2] = ai - bi;
+			ar = re[i + 1];
+			ai = im[i + 1];
+			float tr = im[i + 3];
+			float ti = -re[i + 3];
+			re[i + 1] = ar + tr;
+			im[i + 1] = ai + ti;
+			re[i + 3] = ar - tr;
+			im[i + 3] = ai - ti;
+		}
+		for (int span = 4; span < half; span *= 2) {
+			const float* wRe = &twiddleRe[span - 4];
+			const float* wIm = &twiddleIm[span - 4];
+			for (int i = 0; i < half; i += span * 2) {
+				for (int j = i; j < i + span; j += 4) {
+					float_4 ar = float_4::load(&re[j]);
+					float_4 ai = float_4::load(&im[j]);
+					float_4 br = float_4::load(&re[j + span]);
+					float_4 bi = float_4::load(&im[j + span]);
+					float_4 wr = float_4::load(&wRe[j - i]);
+					float_4 wi = float_4::load(&wIm[j - i]);
+					float_4 tr = br * wr - bi * wi;
+					float_4 ti = br * wi + bi * wr;
+					(ar + tr).store(&re[j]);
+					(ai + ti).store(&im[j]);
+					(ar - tr).store(&re[j + span]);
+					(ai - ti).store(&im[j + span]);
+				}
+			}
+		}
+	}
+
+	// N real samples in, bins 0 to N/2 out
+	void forward(const float* x, float* outRe, float* outIm) {
+		for (int n = 0; n < half; n++) {
+			int r = bitReverse[n];
+			workRe[n] = x[2 * r];
+			workIm[n] = x[2 * r + 1];
+		}
+		transform(workRe, workIm);
+
+		// Even and odd samples were packed as real and imaginary parts, separate them
+		outRe[0] = workRe[0] + workIm[0];
+		outIm[0] = 0.f;
+		outRe[half] = workRe[0] - workIm[0];
+		outIm[half] = 0.f;
+		for (int k = 1; k < half; k++) {
+			float zr = workRe[k], zi = workIm[k];
+			float cr = workRe[half - k], ci = -workIm[half - k];
+			float er = (zr + cr) * 0.5f, ei = (zi + ci) * 0.5f;
+			float or_ = (zi - ci) * 0.5f, oi = (cr - zr) * 0.5f;
+			outRe[k] = er + splitRe[k] * or_ - splitIm[k] * oi;
+			outIm[k] = ei + splitRe[k] * oi + splitIm[k] * or_;
+		}
+	}
+
+	// Bins 0 to N/2 in, N real samples out, scaled by N/2. The caller folds 2/N into its window.
+	void inverse(const float* inRe, const float* inIm, float* x) {
+		for (int k = 0; k < half; k++) {
+			float xr = inRe[k], xi = inIm[k];
+			float cr = inRe[half - k], ci = -inIm[half - k];
+			float er = (xr + cr) * 0.5f, ei = (xi + ci) * 0.5f;
+			float dr = (xr - cr) * 0.5f, di = (xi - ci) * 0.5f;
+			float or_ = dr * splitRe[k] + di * splitIm[k];
+			float oi = di * splitRe[k] - dr * splitIm[k];
+			// Conjugated, so the forward transform runs backwards
+			int r = bitReverse[k];
+			workRe[r] = er - oi;
+			workIm[r] = -(ei + or_);
+		}
+		transform(workRe, workIm);
+		for (int n = 0; n < half; n++) {
+			x[2 * n] = workRe[n];
+			x[2 * n + 1] = -workIm[n];
+		}
+	}
+};
+
+// Spectral superposition. The input is STFT-analysed, every main tap delays whole frames of
+// the spectral history, and each bin has its own tap weights, so a collapse picks a dominant
+// tap per bin. The wet path is QUANTUM_SPECTRAL_SIZE frames late; tap delays are shortened by
+// that much where they are long enough, shorter taps arrive late by the difference. Delays
+// stop at QUANTUM_SPECTRAL_MAX_DELAY.
+//
+// Tables, windows and frames live in one arena from the buffer pool, allocated off the audio
+// thread when the engine is first asked for spectral mode.
+template <int TAPS>
+struct QuantumSpectral {
+	static constexpr int SIZE = QUANTUM_SPECTRAL_SIZE;
+	static constexpr int HOP = QUANTUM_SPECTRAL_HOP;
+	static constexpr int STRIDE = QUANTUM_SPECTRAL_STRIDE;
+	static constexpr int FRAMES = QUANTUM_SPECTRAL_FRAMES;
+
+	QuantumRealFFT fft;
+	char* memory = nullptr;
+	size_t memoryBytes = 0;
+
+	float* analysisWindow; // [SIZE]
+	float* synthesisWindow; // [SIZE], includes the overlap-add and inverse scaling
+	float* inputRing[2]; // [SIZE], last SIZE input frames
+	float* outputRing[2]; // [SIZE], overlap-add accumulator for the next SIZE frames
+	float* frame; // [SIZE], windowed time-domain scratch
+	// History [frame][channel][bin], real and imaginary parts apart
+	float* historyRe;
+	float* historyIm;
+	// Per-bin weights [tap][bin]
+	float* binWeights;
+	float* binTargets;
+	// Spectra of the current hop [channel][bin]
+	float* spectrumRe;
+	float* spectrumIm;
+	float* wetRe;
+	float* wetIm;
+	float* feedbackRe;
+	float* feedbackIm;
+
+	int ringIndex = 0;
+	int hopPhase = 0;
+	int historyIndex = 0;
+	uint32_t randomState = 1;
+
+	// Control-rate state from the engine
+	int tapFrames[TAPS];
+	float gainsL[TAPS];
+	float gainsR[TAPS];
+	float probWeights[TAPS];
+	float feedbackGains[TAPS];
+	float chaos = 0.f;
+
+	QuantumSpectral() {
+		QuantumArena measure;
+		layout(measure);
+		memoryBytes = measure.used + QuantumArena::ALIGN;
+		memory = (char*) quantumBufferPool().allocate(memoryBytes);
+
+		QuantumArena arena;
+		arena.base = (char*)(((uintptr_t) memory + QuantumArena::ALIGN - 1) & ~(uintptr_t)(QuantumArena::ALIGN - 1));
+		layout(arena);
+		fft.plan();
+
+		// Hann analysis and synthesis windows sum to 1.5 at 75% overlap
+		for (int n = 0; n < SIZE; n++) {
+			float w = 0.5f - 0.5f * std::cos(2.f * M_PI * n / SIZE);
+			analysisWindow[n] = w;
+			synthesisWindow[n] = w * (2.f / SIZE) / 1.5f;
+		}
+		for (int i = 0; i < TAPS; i++) {
+			tapFrames[i] = 0;
+			gainsL[i] = 1.f;
+			gainsR[i] = 1.f;
+			probWeights[i] = 1.f / TAPS;
+			feedbackGains[i] = 0.f;
+		}
+		reset();
+	}
+
+	~QuantumSpectral() {
+		quantumBufferPool().release(memory, memoryBytes);
+	}
+
+	void layout(QuantumArena& arena) {
+		fft.layout(arena, SIZE);
+		analysisWindow = arena.take<float>(SIZE);
+		synthesisWindow = arena.take<float>(SIZE);
+		for (int c = 0; c < 2; c++) {
+			inputRing[c] = arena.take<float>(SIZE);
+			outputRing[c] = arena.take<float>(SIZE);
+		}
+		frame = arena.take<float>(SIZE);
+		historyRe = arena.take<float>((size_t) FRAMES * 2 * STRIDE);
+		historyIm = arena.take<float>((size_t) FRAMES * 2 * STRIDE);
+		binWeights = arena.take<float>(TAPS * STRIDE);
+		binTargets = arena.take<float>(TAPS * STRIDE);
+		spectrumRe = arena.take<float>(2 * STRIDE);
+		spectrumIm = arena.take<float>(2 * STRIDE);
+		wetRe = arena.take<float>(2 * STRIDE);
+		wetIm = arena.take<float>(2 * STRIDE);
+		feedbackRe = arena.take<float>(2 * STRIDE);
+		feedbackIm = arena.take<float>(2 * STRIDE);
+	}
+
+	void seed(uint32_t seed) {
+		randomState = seed ? seed : 1;
+	}
+
+	// Clears the frames and spreads every bin evenly over the taps, without allocating
+	void reset() {
+		for (int c = 0; c < 2; c++) {
+			std::fill(inputRing[c], inputRing[c] + SIZE, 0.f);
+			std::fill(outputRing[c], outputRing[c] + SIZE, 0.f);
+		}
+		std::fill(historyRe, historyRe + (size_t) FRAMES * 2 * STRIDE, 0.f);
+		std::fill(historyIm, historyIm + (size_t) FRAMES * 2 * STRIDE, 0.f);
+		std::fill(spectrumRe, spectrumRe + 2 * STRIDE, 0.f);
+		std::fill(spectrumIm, spectrumIm + 2 * STRIDE, 0.f);
+		for (int i = 0; i < TAPS; i++) {
+			for (int k = 0; k < STRIDE; k++) {
+				float w = (k < QUANTUM_SPECTRAL_BINS) ? 1.f / TAPS : 0.f;
+				binWeights[i * STRIDE + k] = w;
+				binTargets[i * STRIDE + k] = w;
+			}
+		}
+		ringIndex = 0;
+		hopPhase = 0;
+		historyIndex = 0;
+	}
+
+	// xorshift32, kept apart from the engine's generator so spectral draws never shift it
+	float random() {
+		randomState ^= randomState << 13;
+		randomState ^= randomState >> 17;
+		randomState ^= randomState << 5;
+		return (randomState >> 8) * (1.f / 16777216.f);
+	}
+
+	// A tap drawn with the global probability weights
+	int drawTap() {
+		float u = random();
+		for (int i = 0; i < TAPS - 1; i++) {
+			u -= probWeights[i];
+			if (u < 0.f)
+				return i;
+		}
+		return TAPS - 1;
+	}
+
+	// Control rate: tap delays in samples, pan positions, the global weights and per-tap feedback
+	void setTaps(const float* delayTimes, const float* panPositions, const float* weights, const float* feedback, float chaosAmount) {
+		float sum = 0.f;
+		for (int i = 0; i < TAPS; i++)
+			sum += weights[i];
+		for (int i = 0; i < TAPS; i++) {
+			float delay = std::min(delayTimes[i], (float) QUANTUM_SPECTRAL_MAX_DELAY);
+			tapFrames[i] = std::max((int) std::round((delay - SIZE) / HOP), 0);
+			gainsL[i] = std::min(1.f, 1.f - panPositions[i]);
+			gainsR[i] = std::min(1.f, 1.f + panPositions[i]);
+			probWeights[i] = (sum > 0.f) ? weights[i] / sum : 1.f / TAPS;
+			feedbackGains[i] = feedback[i];
+		}
+		chaos = chaosAmount;
+	}
+
+	// Every bin collapses onto its own dominant tap
+	void collapse() {
+		for (int k = 0; k < QUANTUM_SPECTRAL_BINS; k++) {
+			int dominant = drawTap();
+			for (int i = 0; i < TAPS; i++)
+				binTargets[i * STRIDE + k] = (i == dominant) ? 0.7f : 0.3f / (TAPS - 1);
+		}
+	}
+
+	// One frame in, one frame out, lanes {L, R, 0, 0}
+	float_4 process(float inL, float inR, bool frozen) {
+		inputRing[0][ringIndex] = inL;
+		inputRing[1][ringIndex] = inR;
+		float outL = outputRing[0][ringIndex];
+		float outR = outputRing[1][ringIndex];
+		outputRing[0][ringIndex] = 0.f;
+		outputRing[1][ringIndex] = 0.f;
+		ringIndex = (ringIndex + 1) & (SIZE - 1);
+
+		if (++hopPhase >= HOP) {
+			hopPhase = 0;
+			processHop(frozen);
+		}
+		return float_4(outL, outR, 0.f, 0.f);
+	}
+
+	// Bins wander: with chaos, a share of them redraw their weights around the global ones
+	void updateBinWeights() {
+		int redraws = 1 + (int)(chaos * QUANTUM_SPECTRAL_BINS * 0.05f);
+		for (int r = 0; r < redraws; r++) {
+			int k = std::min((int)(random() * QUANTUM_SPECTRAL_BINS), QUANTUM_SPECTRAL_BINS - 1);
+			float targets[TAPS];
+			float sum = 0.f;
+			for (int i = 0; i < TAPS; i++) {
+				targets[i] = probWeights[i] * std::exp2((random() * 2.f - 1.f) * 2.f * chaos);
+				sum += targets[i];
+			}
+			for (int i = 0; i < TAPS; i++)
+				binTargets[i * STRIDE + k] = targets[i] / sum;
+		}
+		// Glide towards the targets; sums stay at one since both sides sum to one
+		for (int i = 0; i < TAPS * STRIDE; i += 4) {
+			float_4 w = float_4::load(&binWeights[i]);
+			float_4 t = float_4::load(&binTargets[i]);
+			(w + (t - w) * 0.1f).store(&binWeights[i]);
+		}
+	}
+
+	void processHop(bool frozen) {
+		// Analysis, oldest frame first
+		for (int c = 0; c < 2; c++) {
+			for (int n = 0; n < SIZE; n++)
+				frame[n] = inputRing[c][(ringIndex + n) & (SIZE - 1)] * analysisWindow[n];
+			fft.forward(frame, &spectrumRe[c * STRIDE], &spectrumIm[c * STRIDE]);
+		}
+
+		// A frozen history is replayed as it is, the write slot moves on regardless
+		float* slotRe = &historyRe[(size_t) historyIndex * 2 * STRIDE];
+		float* slotIm = &historyIm[(size_t) historyIndex * 2 * STRIDE];
+		if (!frozen) {
+			std::memcpy(slotRe, spectrumRe, sizeof(float) * 2 * STRIDE);
+			std::memcpy(slotIm, spectrumIm, sizeof(float) * 2 * STRIDE);
+		}
+
+		updateBinWeights();
+
+		std::fill(wetRe, wetRe + 2 * STRIDE, 0.f);
+		std::fill(wetIm, wetIm + 2 * STRIDE, 0.f);
+		std::fill(feedbackRe, feedbackRe + 2 * STRIDE, 0.f);
+		std::fill(feedbackIm, feedbackIm + 2 * STRIDE, 0.f);
+		for (int i = 0; i < TAPS; i++) {
+			int source = (historyIndex - tapFrames[i]) & (FRAMES - 1);
+			const float* tapRe = &historyRe[(size_t) source * 2 * STRIDE];
+			const float* tapIm = &historyIm[(size_t) source * 2 * STRIDE];
+			const float* weights = &binWeights[i * STRIDE];
+			float_4 gains[2] = {gainsL[i], gainsR[i]};
+			float_4 feedbackGain = feedbackGains[i];
+			for (int c = 0; c < 2; c++) {
+				int offset = c * STRIDE;
+				for (int k = 0; k < STRIDE; k += 4) {
+					float_4 w = float_4::load(&weights[k]);
+					float_4 re = float_4::load(&tapRe[offset + k]) * w;
+					float_4 im = float_4::load(&tapIm[offset + k]) * w;
+					(float_4::load(&feedbackRe[offset + k]) + re * feedbackGain).store(&feedbackRe[offset + k]);
+					(float_4::load(&feedbackIm[offset + k]) + im * feedbackGain).store(&feedbackIm[offset + k]);
+					(float_4::load(&wetRe[offset + k]) + re * gains[c]).store(&wetRe[offset + k]);
+					(float_4::load(&wetIm[offset + k]) + im * gains[c]).store(&wetIm[offset + k]);
+				}
+			}
+		}
+
+		if (!frozen) {
+			for (int k = 0; k < 2 * STRIDE; k += 4) {
+				(float_4::load(&slotRe[k]) + float_4::load(&feedbackRe[k])).store(&slotRe[k]);
+				(float_4::load(&slotIm[k]) + float_4::load(&feedbackIm[k])).store(&slotIm[k]);
+			}
+		}
+		historyIndex = (historyIndex + 1) & (FRAMES - 1);
+
+		// Synthesis and overlap-add, the first sample is due next frame
+		for (int c = 0; c < 2; c++) {
+			fft.inverse(&wetRe[c * STRIDE], &wetIm[c * STRIDE], frame);
+			for (int n = 0; n < SIZE; n++)
+				outputRing[c][(ringIndex + n) & (SIZE - 1)] += frame[n] * synthesisWindow[n];
+		}
+	}
+};
@@ -0,0 +1,40 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+
+// Lock-free ring for exactly one producer thread and one consumer thread.
+// The producer fills back() in place and publishes it with push(); the consumer reads
+// front() in place and frees it with pop(). CAPACITY must be a power of two.
+template <typename T, int CAPACITY>
+struct QuantumSpscRing {
+	static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+	T items[CAPACITY];
+	// Free-running counters on separate cache lines, so each side only writes its own
+	alignas(64) std::atomic<uint32_t> head{0}; // next slot to publish, producer
+	alignas(64) std::atomic<uint32_t> tail{0}; // next slot to read, consumer
+
+	// Producer: the slot to fill, or null while the ring is full
+	T* back() {
+		uint32_t h = head.load(std::memory_order_relaxed);
+		if (h - tail.load(std::memory_order_acquire) >= (uint32_t) CAPACITY)
+			return nullptr;
+		return &items[h & (CAPACITY - 1)];
+	}
+
+	void push() {
+		head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Consumer: the oldest published slot, or null while the ring is empty
+	T* front() {
+		uint32_t t = tail.load(std::memory_order_relaxed);
+		if (t == head.load(std::memory_order_acquire))
+			return nullptr;
+		return &items[t & (CAPACITY - 1)];
+	}
+
+	void pop() {
+		tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+};
@@ -1,5 +1,12 @@
+#include <ctime>
+#include <thread>
+#include <osdialog.h>
+
 #include "plugin.hpp"
-#include <random>
+#include "QuantumOffload.hpp"
+#include "QuantumRecorder.hpp"
+
+extern Model* modelQuantumSuperpositionBank;
 
 struct QuantumSuperpositionDelay : Module {
 	enum ParamId {
@@ -9,6 +16,12 @@ struct QuantumSuperpositionDelay : Module {
 		FEEDBACK_PARAM,
 		MIX_PARAM,
 		CHAOS_PARAM,
+		WIDTH_PARAM,
+		FREEZE_PARAM,
+		FEEDBACK_TONE_PARAM,
+		TONE_SPREAD_PARAM,
+		MOD_DEPTH_PARAM,
+		MOD_RATE_PARAM,
 		PARAMS_LEN
 	};
 	enum InputId {
@@ -17,10 +30,15 @@ struct QuantumSuperpositionDelay : Module {
 		CV_SPREAD_INPUT,
 		CV_FEEDBACK_INPUT,
 		COLLAPSE_TRIGGER_INPUT,
+		AUDIO_R_INPUT,
+		FREEZE_INPUT,
 		INPUTS_LEN
 	};
 	enum OutputId {
 		AUDIO_OUTPUT,
+		AUDIO_R_OUTPUT,
+		TAPS_OUTPUT,
+		WEIGHTS_OUTPUT,
 		OUTPUTS_LEN
 	};
 	enum LightId {
@@ -31,42 +49,101 @@ struct QuantumSuperpositionDelay : Module {
 		BUFFER_LIGHT_4,
 		BUFFER_LIGHT_5,
 		BUFFER_LIGHT_6,
+		FREEZE_LIGHT,
 		LIGHTS_LEN
 	};
 
-	static constexpr int NUM_BUFFERS = 6;
-	static constexpr int MAX_DELAY_SAMPLES = 96000; // 2 seconds at 48kHz
-	static constexpr int BUFFER_SIZE = MAX_DELAY_SAMPLES / NUM_BUFFERS;
-
-	// Delay buffers
-	float delayBuffers[NUM_BUFFERS][BUFFER_SIZE];
-	int writeIndex = 0;
-	int readIndices[NUM_BUFFERS] = {0};
-
-	// Quantum state variables
-	float probWeights[NUM_BUFFERS];
-	float targetWeights[NUM_BUFFERS];
-	float weightVelocity[NUM_BUFFERS];
-	float delayTimes[NUM_BUFFERS]; // in samples
-	float feedbackLevels[NUM_BUFFERS];
-	float entanglement[NUM_BUFFERS];
-
-	// Control variables
-	float baseDelayTime = 0.5f; // 0-1 range
-	float spreadAmount = 0.5f;
-	float probabilityShape = 0.5f;
-	float globalFeedback = 0.3f;
-	float dryWetMix = 0.5f;
-	float chaosAmount = 0.1f;
+	static constexpr int NUM_LIGHTS = 6;
+
+	// DSP engine, specialised for the selected tap count, interpolation and storage.
+	// Replacements are built off the audio thread and swapped in at the top of process().
+	QuantumEngineBase* engine = nullptr;
+	std::atomic<QuantumEngineBase*> pendingEngine{nullptr};
+	std::atomic<QuantumEngineBase*> retiredEngine{nullptr};
+	// UI thread: the engine built last, whether or not process() has swapped it in yet. It is
+	// not freed before a newer one is built.
+	QuantumEngineBase* newestEngine = nullptr;
+	int tapCount = 6;
+	int interpolation = INTERP_LINEAR;
+	int sampleFormat = SAMPLE_FLOAT;
+	// 1, 2 or 4 times the host rate
+	int oversampling = 1;
+	// Render on a worker thread, `offloadLatency` frames late
+	bool offload = false;
+	int offloadLatency = 1024;
+	// Minutes of shared history in tape mode, 0 for the plain buffers
+	int tapeMinutes = 0;
+	// A history preloaded from a sample, swapped in at the next control tick like an engine
+	std::atomic<QuantumHistory*> pendingHistory{nullptr};
+	std::atomic<QuantumHistory*> retiredHistory{nullptr};
+	// Replaced buffers stay on the audio thread until the last bank has had a message without
+	// them, one frame per hop down the chain; only then does the widget get to free them
+	static constexpr int DRAIN_FRAMES = QUANTUM_MAX_BANKS + 1;
+	QuantumEngineBase* drainingEngine = nullptr;
+	QuantumHistory* drainingHistory = nullptr;
+	int drainFrames = 0;
+	std::string sampleName;
+	std::string sampleError;
+	// Samples are decoded into a history on a thread of their own, one at a time, for the
+	// newest engine. Its name and error are the UI thread's once loaderDone is set. No newer
+	// engine is built while it runs.
+	std::thread loader;
+	std::atomic<bool> loaderDone{false};
+	std::string loaderName;
+	std::string loaderError;
+	// Set by process() when a swap handed a loaded history back, the engine having changed
+	std::atomic<bool> historyRejected{false};
+
+	QuantumControls controls;
+	int panMode = PAN_STATIC;
+	bool midSide = false;
+
+	// Granular read mode
+	bool granular = false;
+	float grainSize = 0.5f;
+	float grainDensity = 0.5f;
+
+	// Chaos-assigned reverse, half and double speed taps
+	bool varispeed = false;
+
+	// Low, mid and high bands collapse independently
+	bool multiband = false;
+
+	// STFT tap mix with per-bin weights
+	bool spectral = false;
+
+	// Collapses snap the weights with a short declick instead of gliding
+	bool hardCollapse = false;
+
+	// LFO shape of the tap modulation, depth and rate are knobs
+	int modShape = LFO_SINE;
+
+	// Per-tap poly outputs
+	bool stereoTapOutputs = false; // L/R interleaved, twice the channels
+	bool tapsOutputConnected = false;
+
+	// Takes of the output, plus the per-tap channels when `recordTaps` is set
+	QuantumRecorder recorder;
+	bool recordTaps = false;
+	std::string recorderError;
+	float recordedTaps[16] = {}; // per-tap voltages while the taps output is unpatched
+
+	// Expander chain
+	QuantumBankReturn bankReturns[2];
+
+	dsp::ClockDivider controlDivider;
+
+#ifdef QSD_PROFILE
+	QuantumProfiler profiler;
+#endif
+
+	// Freeze gate, held while high
+	dsp::SchmittTrigger freezeTrigger;
 
 	// Collapse trigger
 	dsp::SchmittTrigger collapseTrigger;
 	float collapseLight = 0.f;
 
-	// Random number generator
-	std::mt19937 rng;
-	std::uniform_real_distribution<float> uniformDist;
-
 	QuantumSuperpositionDelay() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
 		
@@ -76,53 +153,189 @@ struct QuantumSuperpositionDelay : Module {
 		configParam(FEEDBACK_PARAM, 0.f, 0.95f, 0.3f, "Feedback", "%", 0.f, 100.f);
 		configParam(MIX_PARAM, 0.f, 1.f, 0.5f, "Dry/Wet Mix", "%", 0.f, 100.f);
 		configParam(CHAOS_PARAM, 0.f, 1.f, 0.1f, "Chaos Amount", "%", 0.f, 100.f);
+		configParam(WIDTH_PARAM, 0.f, 1.f, 0.5f, "Stereo Width", "%", 0.f, 100.f);
+		configSwitch(FREEZE_PARAM, 0.f, 1.f, 0.f, "Freeze", {"Off", "On"});
+		configParam(FEEDBACK_TONE_PARAM, 0.f, 1.f, 0.f, "Feedback Tone", "%", 0.f, 100.f);
+		configParam(TONE_SPREAD_PARAM, 0.f, 1.f, 0.5f, "Tone Spread Across Taps", "%", 0.f, 100.f);
+		configParam(MOD_DEPTH_PARAM, 0.f, 1.f, 0.f, "Tap Modulation Depth", " ms", 0.f, QUANTUM_MOD_MAX_MS);
+		configParam(MOD_RATE_PARAM, 0.f, 1.f, 0.3f, "Tap Modulation Rate", " Hz", 200.f, 0.05f);
 
-		configInput(AUDIO_INPUT, "Audio");
+		configInput(AUDIO_INPUT, "Left/Mono Audio");
 		configInput(CV_PROB_INPUT, "Probability Distribution CV");
 		configInput(CV_SPREAD_INPUT, "Time Spread CV");
 		configInput(CV_FEEDBACK_INPUT, "Feedback CV");
 		configInput(COLLAPSE_TRIGGER_INPUT, "Quantum Collapse Trigger");
+		configInput(AUDIO_R_INPUT, "Right Audio");
+		configInput(FREEZE_INPUT, "Freeze Gate");
 
-		configOutput(AUDIO_OUTPUT, "Audio");
+		configOutput(AUDIO_OUTPUT, "Left/Mono Audio");
+		configOutput(AUDIO_R_OUTPUT, "Right Audio");
+		configOutput(TAPS_OUTPUT, "Per-tap Audio (polyphonic)");
+		configOutput(WEIGHTS_OUTPUT, "Probability Weights (polyphonic, 0-10V)");
 
 		configLight(COLLAPSE_LIGHT, "Collapse Event");
-		for (int i = 0; i < NUM_BUFFERS; i++) {
+		for (int i = 0; i < NUM_LIGHTS; i++) {
 			configLight(BUFFER_LIGHT_1 + i, string::f("Buffer %d Activity", i + 1));
 		}
+		configLight(FREEZE_LIGHT, "Frozen");
+
+		engine = buildEngine(tapCount, interpolation, sampleFormat);
+		newestEngine = engine;
+#ifdef QSD_PROFILE
+		engine->profiler = &profiler;
+#endif
+		controlDivider.setDivision(64);
+
+		rightExpander.producerMessage = &bankReturns[0];
+		rightExpander.consumerMessage = &bankReturns[1];
+	}
+
+	~QuantumSuperpositionDelay() {
+		finishLoading();
+		delete engine;
+		delete pendingEngine.load();
+		delete retiredEngine.load();
+		delete pendingHistory.load();
+		delete retiredHistory.load();
+		delete drainingEngine;
+		delete drainingHistory;
+	}
+
+	// Call from the UI thread
+	QuantumEngineBase* buildEngine(int taps, int interp, int format) {
+		QuantumEngineBase* newEngine = createQuantumEngine(taps, interp, format, oversampling);
+		attachTape(newEngine);
+		if (spectral)
+			newEngine->prepareSpectral();
+		if (offload)
+			newEngine = new QuantumOffloadEngine(newEngine, offloadLatency);
+		return newEngine;
+	}
+
+	// Call from the UI thread. The scratch file goes in the user folder: patch storage is
+	// archived into the patch file on every save, and the tape holds minutes of audio.
+	void attachTape(QuantumEngineBase* newEngine) {
+		if (tapeMinutes <= 0)
+			return;
+		std::string directory = asset::user("QuantumSuperposition");
+		system::createDirectories(directory);
+		std::string path = system::join(directory, string::f("tape-%lld.f32", (long long) id));
+		double frames = tapeMinutes * 60.0 * APP->engine->getSampleRate() * oversampling;
+		newEngine->setTape(new QuantumTape(path, (int) std::min(frames, (double) QuantumTape::MAX_FRAMES)));
+	}
 
-		// Initialize buffers
-		for (int b = 0; b < NUM_BUFFERS; b++) {
-			for (int i = 0; i < BUFFER_SIZE; i++) {
-				delayBuffers[b][i] = 0.f;
+	// Call from the UI thread. The file's tail is decoded and resampled straight out of a
+	// mapping of it into a fresh history, so a long file is never read in whole, and
+	// process() swaps the history in. Full scale is 5 V, like the recorder's takes. A tape's
+	// worth takes a while, so the loader thread does it; a load already running wins.
+	void loadSample(const std::string& path) {
+		if (loader.joinable())
+			return;
+		sampleError.clear();
+		// The oversampling setting is the one the newest engine was built with
+		QuantumEngineBase* target = newestEngine;
+		double rate = APP->engine->getSampleRate() * oversampling;
+		std::string name = system::getFilename(path);
+		loader = std::thread([this, path, target, rate, name]() {
+			loaderName.clear();
+			loaderError.clear();
+			WavMapping file;
+			if (file.open(path, &loaderError)) {
+				WavTailResampler resampler(file, rate, target->getHistoryFrames());
+				QuantumHistory* history = target->buildHistory([&](float* frames, int count) {
+					int read = resampler.read(frames, count);
+					for (int i = 0; i < read * 2; i++)
+						frames[i] *= 5.f;
+					return read;
+				});
+				if (history) {
+					loaderName = name;
+					delete pendingHistory.exchange(history);
+				} else {
+					loaderError = "no memory for a second tape";
+				}
 			}
+			loaderDone = true;
+		});
+	}
+
+	bool loading() {
+		return loader.joinable();
+	}
+
+	// Call from the UI thread. Takes up a finished load's outcome, or waits for it if `wait`.
+	void collectLoader(bool wait) {
+		if (loader.joinable() && (wait || loaderDone)) {
+			loader.join();
+			loaderDone = false;
+			if (!loaderName.empty())
+				sampleName = loaderName;
+			sampleError = loaderError;
+		}
+		if (historyRejected.exchange(false)) {
+			sampleName.clear();
+			sampleError = "the engine changed before the sample was in, load it again";
 		}
+	}
 
-		// Initialize quantum state
-		initializeQuantumState();
+	void finishLoading() {
+		collectLoader(true);
+	}
 
-		// Seed RNG
-		rng.seed(std::random_device{}());
-		uniformDist = std::uniform_real_distribution<float>(0.f, 1.f);
+	// Call from the UI thread. Takes go to the user folder, named by their start time.
+	void startRecording() {
+		std::string directory = system::join(asset::user("QuantumSuperposition"), "recordings");
+		system::createDirectories(directory);
+		std::time_t now = std::time(nullptr);
+		char name[64];
+		std::strftime(name, sizeof(name), "qsd-%Y%m%d-%H%M%S.wav", std::localtime(&now));
+		int taps = newestEngine->getTapCount();
+		int tapChannels = recordTaps ? std::min(stereoTapOutputs ? taps * 2 : taps, 16) : 0;
+		recorderError.clear();
+		recorder.start(system::join(directory, name), 2 + tapChannels, (int) APP->engine->getSampleRate(), &recorderError);
 	}
 
-	void initializeQuantumState() {
-		float equalWeight = 1.f / NUM_BUFFERS;
-		
-		for (int i = 0; i < NUM_BUFFERS; i++) {
-			probWeights[i] = equalWeight;
-			targetWeights[i] = equalWeight;
-			weightVelocity[i] = 0.f;
-			delayTimes[i] = 1000.f + (i * 1500.f); // Initial spread in samples
-			feedbackLevels[i] = 0.3f;
-			entanglement[i] = 0.f;
-		}
+	// Call from the UI thread
+	void setEngineConfig(int taps, int interp, int format) {
+		finishLoading();
+		QuantumEngineBase* newEngine = buildEngine(taps, interp, format);
+		tapCount = newEngine->getTapCount();
+		interpolation = newEngine->getInterpolation();
+		sampleFormat = newEngine->getSampleFormat();
+		newestEngine = newEngine;
+		delete pendingEngine.exchange(newEngine);
+	}
+
+	void swapEngine() {
+		// One swap drains at a time, the next waits a few frames
+		if (drainFrames > 0)
+			return;
+		QuantumEngineBase* newEngine = pendingEngine.exchange(nullptr);
+		if (!newEngine)
+			return;
+		newEngine->controls = controls;
+#ifdef QSD_PROFILE
+		newEngine->profiler = &profiler;
+#endif
+		drainingEngine = engine;
+		drainFrames = DRAIN_FRAMES;
+		engine = newEngine;
 	}
 
-	float fastRandom() {
-		return uniformDist(rng);
+	void drainRetired() {
+		if (drainFrames == 0 || --drainFrames > 0)
+			return;
+		// Freed by the widget; if it has not collected the last ones yet, keep the newer
+		if (drainingEngine)
+			delete retiredEngine.exchange(drainingEngine);
+		if (drainingHistory)
+			delete retiredHistory.exchange(drainingHistory);
+		drainingEngine = nullptr;
+		drainingHistory = nullptr;
 	}
 
-	void updateControls() {
+	void updateControls(float sampleRate) {
+		QUANTUM_PROFILE_SCOPE(&profiler, PROFILE_CONTROLS);
 		// Read parameters
 		float potTime = params[DELAY_TIME_PARAM].getValue();
 		float potSpread = params[SPREAD_PARAM].getValue();
@@ -137,198 +350,218 @@ struct QuantumSuperpositionDelay : Module {
 		float cvFeedback = inputs[CV_FEEDBACK_INPUT].getVoltage() / 10.f;
 
 		// Combine pot + CV
-		baseDelayTime = clamp(potTime, 0.f, 1.f);
-		spreadAmount = clamp(potSpread + cvSpread, 0.f, 1.f);
-		probabilityShape = clamp(potProb + cvProb, 0.f, 1.f);
-		globalFeedback = clamp(potFeedback + cvFeedback, 0.f, 0.95f);
-		dryWetMix = potMix;
-		chaosAmount = potChaos;
-	}
+		controls.delayTime = clamp(potTime, 0.f, 1.f);
+		controls.spread = clamp(potSpread + cvSpread, 0.f, 1.f);
+		controls.probability = clamp(potProb + cvProb, 0.f, 1.f);
+		controls.feedback = clamp(potFeedback + cvFeedback, 0.f, 0.95f);
+		controls.mix = potMix;
+		controls.chaos = potChaos;
+		controls.feedbackTone = params[FEEDBACK_TONE_PARAM].getValue();
+		controls.toneSpread = params[TONE_SPREAD_PARAM].getValue();
+		controls.modDepth = params[MOD_DEPTH_PARAM].getValue();
+		controls.modRate = params[MOD_RATE_PARAM].getValue();
+		controls.modShape = modShape;
 
-	void updateProbabilityWeights() {
-		float weights[NUM_BUFFERS];
+		// Without a right output the module stays mono, so all taps sit in the centre
+		controls.width = outputs[AUDIO_R_OUTPUT].isConnected() ? params[WIDTH_PARAM].getValue() : 0.f;
+		controls.panMode = panMode;
+		controls.midSide = midSide;
+		controls.granular = granular;
+		controls.grainSize = grainSize;
+		controls.grainDensity = grainDensity;
+		controls.varispeed = varispeed;
+		controls.multiband = multiband;
+		controls.spectral = spectral;
+		controls.hardCollapse = hardCollapse;
+		controls.sampleRate = sampleRate;
 
-		if (probabilityShape < 0.5f) {
-			// More uniform distribution
-			float uniformity = (0.5f - probabilityShape) * 2.f;
-			for (int i = 0; i < NUM_BUFFERS; i++) {
-				weights[i] = (1.f - uniformity) * targetWeights[i] + uniformity / NUM_BUFFERS;
-			}
-		} else {
-			// More peaked distribution
-			float peakedness = (probabilityShape - 0.5f) * 2.f;
-			
-			static float peakCenter = NUM_BUFFERS / 2.f;
-			peakCenter += (fastRandom() - 0.5f) * chaosAmount * 0.5f;
-			peakCenter = clamp(peakCenter, 0.f, (float)(NUM_BUFFERS - 1));
-
-			float totalWeight = 0.f;
-			for (int i = 0; i < NUM_BUFFERS; i++) {
-				float distance = std::abs(i - peakCenter);
-				weights[i] = std::exp(-distance * peakedness * 2.f);
-				totalWeight += weights[i];
-			}
+		// Button latches, the gate holds; either one freezes
+		freezeTrigger.process(inputs[FREEZE_INPUT].getVoltage(), 0.1f, 2.f);
+		controls.freeze = params[FREEZE_PARAM].getValue() > 0.5f || freezeTrigger.isHigh();
+		lights[FREEZE_LIGHT].setBrightness(controls.freeze);
 
-			// Normalize
-			for (int i = 0; i < NUM_BUFFERS; i++) {
-				weights[i] /= totalWeight;
-			}
-		}
-
-		// Add chaos
-		for (int i = 0; i < NUM_BUFFERS; i++) {
-			float chaos = (fastRandom() - 0.5f) * chaosAmount * 0.1f;
-			weights[i] = clamp(weights[i] + chaos, 0.f, 1.f);
-		}
+		engine->controls = controls;
+	}
 
-		// Normalize after chaos
-		float sum = 0.f;
-		for (int i = 0; i < NUM_BUFFERS; i++) {
-			sum += weights[i];
-		}
-		for (int i = 0; i < NUM_BUFFERS; i++) {
-			targetWeights[i] = weights[i] / sum;
+	void updateLights() {
+		QUANTUM_PROFILE_SCOPE(&profiler, PROFILE_LIGHTS);
+		// Fold the engine's taps onto the six buffer lights
+		const float* probWeights = engine->getProbWeights();
+		int taps = engine->getTapCount();
+		float brightness[NUM_LIGHTS] = {};
+		for (int i = 0; i < taps; i++) {
+			brightness[i * NUM_LIGHTS / taps] += probWeights[i];
 		}
 
-		// Smooth interpolation
-		for (int i = 0; i < NUM_BUFFERS; i++) {
-			float error = targetWeights[i] - probWeights[i];
-			weightVelocity[i] = weightVelocity[i] * 0.9f + error * 0.1f;
-			probWeights[i] += weightVelocity[i] * 0.05f;
+		// Update buffer activity lights
+		for (int i = 0; i < NUM_LIGHTS; i++) {
+			lights[BUFFER_LIGHT_1 + i].setBrightness(brightness[i]);
 		}
 	}
 
-	void updateDelayTimes(float sampleRate) {
-		// Convert base delay time from 0-1 to samples
-		float minDelaySamples = 10.f; // ~0.2ms minimum
-		float maxDelaySamples = (baseDelayTime * 2000.f / 1000.f) * sampleRate; // 0-2000ms
-		maxDelaySamples = clamp(maxDelaySamples, minDelaySamples, (float)(BUFFER_SIZE - 1));
-
-		for (int i = 0; i < NUM_BUFFERS; i++) {
-			float t = i / (float)(NUM_BUFFERS - 1);
-			float delayRange = (maxDelaySamples - minDelaySamples) * spreadAmount;
-			delayTimes[i] = minDelaySamples + t * delayRange;
-
-			// Add slight randomization
-			delayTimes[i] += (fastRandom() - 0.5f) * sampleRate * 0.005f * chaosAmount;
-			delayTimes[i] = clamp(delayTimes[i], 1.f, (float)(BUFFER_SIZE - 1));
+	void updatePolyOutputs() {
+		const float* probWeights = engine->getProbWeights();
+		int taps = engine->getTapCount();
 
-			// Calculate read index
-			int delaySamples = (int)delayTimes[i];
-			readIndices[i] = (writeIndex - delaySamples + BUFFER_SIZE) % BUFFER_SIZE;
+		// Weights only move at control rate, so the output holds them between ticks
+		outputs[WEIGHTS_OUTPUT].setChannels(taps);
+		for (int i = 0; i < taps; i++) {
+			outputs[WEIGHTS_OUTPUT].setVoltage(probWeights[i] * 10.f, i);
 		}
+
+		tapsOutputConnected = outputs[TAPS_OUTPUT].isConnected();
+		outputs[TAPS_OUTPUT].setChannels(std::min(stereoTapOutputs ? taps * 2 : taps, 16));
 	}
 
-	void handleQuantumCollapse() {
-		int dominantBuffer = fastRandom() * NUM_BUFFERS;
-		float collapseFactor = 0.7f;
+	void process(const ProcessArgs& args) override {
+		drainRetired();
+		swapEngine();
 
-		for (int i = 0; i < NUM_BUFFERS; i++) {
-			if (i == dominantBuffer) {
-				targetWeights[i] = collapseFactor;
-			} else {
-				targetWeights[i] = (1.f - collapseFactor) / (NUM_BUFFERS - 1);
-			}
+		bool bankAttached = rightExpander.module && rightExpander.module->model == modelQuantumSuperpositionBank;
+		QuantumBankReturn bankReturn;
+		if (bankAttached) {
+			// Bank audio arriving this frame
+			bankReturn = *(QuantumBankReturn*) rightExpander.consumerMessage;
 		}
 
-		collapseLight = 1.f;
-	}
-
-	void process(const ProcessArgs& args) override {
 		// Update controls periodically
-		static int controlDivider = 0;
-		if (++controlDivider >= 64) {
-			controlDivider = 0;
-			updateControls();
-			updateProbabilityWeights();
-			updateDelayTimes(args.sampleRate);
+		if (controlDivider.process()) {
+#ifdef QSD_PROFILE
+			profiler.poll();
+#endif
+			controls.numBanks = std::min(bankReturn.bankCount, QUANTUM_MAX_BANKS);
+			// Also collects what an offloaded engine replaced, drained like an engine
+			if (drainFrames == 0) {
+				drainingHistory = engine->swapHistory(pendingHistory.exchange(nullptr));
+				if (drainingHistory)
+					drainFrames = DRAIN_FRAMES;
+				if (drainingHistory && drainingHistory->rejected)
+					historyRejected = true;
+			}
+			updateControls(args.sampleRate);
+			updateLights();
+			updatePolyOutputs();
 		}
 
 		// Check for collapse trigger
 		if (collapseTrigger.process(inputs[COLLAPSE_TRIGGER_INPUT].getVoltage(), 0.1f, 2.f)) {
-			handleQuantumCollapse();
+			engine->collapse();
+			collapseLight = 1.f;
 		}
 
 		// Decay collapse light
 		collapseLight -= collapseLight / args.sampleRate * 5.f;
 		lights[COLLAPSE_LIGHT].setBrightness(collapseLight);
 
-		// Read input
-		float inputSample = inputs[AUDIO_INPUT].getVoltage();
-
-		// Write to all delay buffers
-		for (int b = 0; b < NUM_BUFFERS; b++) {
-			delayBuffers[b][writeIndex] = inputSample;
-		}
-
-		// Read from delay buffers with quantum superposition
-		float outputAccumulator = 0.f;
-
-		for (int b = 0; b < NUM_BUFFERS; b++) {
-			// Read delayed sample with linear interpolation
-			int readIdx = readIndices[b];
-			float frac = delayTimes[b] - (int)delayTimes[b];
-			int readIdxNext = (readIdx + 1) % BUFFER_SIZE;
-			
-			float delayedSample = delayBuffers[b][readIdx] * (1.f - frac) + 
-			                      delayBuffers[b][readIdxNext] * frac;
-
-			// Apply probability weight
-			float weightedSample = delayedSample * probWeights[b];
-			outputAccumulator += weightedSample;
-
-			// Apply feedback with entanglement
-			float feedbackSample = delayedSample * globalFeedback * feedbackLevels[b];
-
-			// Entanglement: feedback influences other buffers
-			for (int other = 0; other < NUM_BUFFERS; other++) {
-				if (other != b) {
-					float entanglementAmount = entanglement[b] * 0.1f;
-					int entangleIndex = (writeIndex + 10) % BUFFER_SIZE;
-					delayBuffers[other][entangleIndex] += feedbackSample * entanglementAmount;
-				}
-			}
+		// Read input, right normalled to left
+		QuantumFrame frame;
+		frame.inL = inputs[AUDIO_INPUT].getVoltage();
+		frame.inR = inputs[AUDIO_R_INPUT].getNormalVoltage(frame.inL);
+		frame.bankL = bankReturn.wetL;
+		frame.bankR = bankReturn.wetR;
+		bool recording = recorder.active();
+		frame.taps = tapsOutputConnected ? outputs[TAPS_OUTPUT].getVoltages() : recording ? recordedTaps : nullptr;
+		frame.stereoTaps = stereoTapOutputs;
 
-			// Self-feedback
-			delayBuffers[b][writeIndex] += feedbackSample;
+		engine->processFrame(frame);
 
-			// Update entanglement based on buffer energy
-			float energy = std::abs(delayedSample) / 10.f; // Normalize to ~0-1
-			entanglement[b] = entanglement[b] * 0.99f + energy * 0.01f;
+		// Output
+		outputs[AUDIO_OUTPUT].setVoltage(frame.outL);
+		outputs[AUDIO_R_OUTPUT].setVoltage(frame.outR);
 
-			// Update buffer activity lights
-			lights[BUFFER_LIGHT_1 + b].setBrightness(probWeights[b]);
+		// Full scale in the file is Rack's 5 V audio level
+		if (recording) {
+			float samples[QuantumRecorder::MAX_CHANNELS];
+			samples[0] = frame.outL / 5.f;
+			samples[1] = frame.outR / 5.f;
+			for (int i = 0; i < 16; i++)
+				samples[2 + i] = frame.taps[i] / 5.f;
+			recorder.record(samples);
 		}
 
-		// Mix dry and wet
-		float wetSample = clamp(outputAccumulator, -10.f, 10.f);
-		float mixedOutput = inputSample * (1.f - dryWetMix) + wetSample * dryWetMix;
-
-		// Output
-		outputs[AUDIO_OUTPUT].setVoltage(mixedOutput);
-
-		// Advance write pointer
-		writeIndex = (writeIndex + 1) % BUFFER_SIZE;
+		// Share the history with the chain, no copy of the buffers is made
+		if (bankAttached) {
+			QuantumBankMessage* message = (QuantumBankMessage*) rightExpander.module->leftExpander.producerMessage;
+			engine->fillBankMessage(message);
+			rightExpander.module->leftExpander.requestMessageFlip();
+		}
 	}
 
 	json_t* dataToJson() override {
 		json_t* rootJ = json_object();
 		
 		// Save quantum state for continuity
+		const float* probWeights = engine->getProbWeights();
 		json_t* weightsJ = json_array();
-		for (int i = 0; i < NUM_BUFFERS; i++) {
+		for (int i = 0; i < engine->getTapCount(); i++) {
 			json_array_append_new(weightsJ, json_real(probWeights[i]));
 		}
 		json_object_set_new(rootJ, "probWeights", weightsJ);
+		json_object_set_new(rootJ, "panMode", json_integer(panMode));
+		json_object_set_new(rootJ, "midSide", json_boolean(midSide));
+		json_object_set_new(rootJ, "granular", json_boolean(granular));
+		json_object_set_new(rootJ, "grainSize", json_real(grainSize));
+		json_object_set_new(rootJ, "grainDensity", json_real(grainDensity));
+		json_object_set_new(rootJ, "varispeed", json_boolean(varispeed));
+		json_object_set_new(rootJ, "multiband", json_boolean(multiband));
+		json_object_set_new(rootJ, "spectral", json_boolean(spectral));
+		json_object_set_new(rootJ, "hardCollapse", json_boolean(hardCollapse));
+		json_object_set_new(rootJ, "modShape", json_integer(modShape));
+		json_object_set_new(rootJ, "stereoTapOutputs", json_boolean(stereoTapOutputs));
+		json_object_set_new(rootJ, "recordTaps", json_boolean(recordTaps));
+		json_object_set_new(rootJ, "tapCount", json_integer(tapCount));
+		json_object_set_new(rootJ, "interpolation", json_integer(interpolation));
+		json_object_set_new(rootJ, "sampleFormat", json_integer(sampleFormat));
+		json_object_set_new(rootJ, "oversampling", json_integer(oversampling));
+		json_object_set_new(rootJ, "offload", json_boolean(offload));
+		json_object_set_new(rootJ, "offloadLatency", json_integer(offloadLatency));
+		json_object_set_new(rootJ, "tapeMinutes", json_integer(tapeMinutes));
 		
 		return rootJ;
 	}
 
 	void dataFromJson(json_t* rootJ) override {
-		// Restore quantum state
+		int taps = 6;
+		int interp = INTERP_LINEAR;
+		int format = SAMPLE_FLOAT;
+
+		json_t* tapCountJ = json_object_get(rootJ, "tapCount");
+		if (tapCountJ)
+			taps = json_integer_value(tapCountJ);
+
+		json_t* interpolationJ = json_object_get(rootJ, "interpolation");
+		if (interpolationJ)
+			interp = json_integer_value(interpolationJ);
+
+		json_t* sampleFormatJ = json_object_get(rootJ, "sampleFormat");
+		if (sampleFormatJ)
+			format = json_integer_value(sampleFormatJ);
+
+		json_t* oversamplingJ = json_object_get(rootJ, "oversampling");
+		if (oversamplingJ) {
+			int factor = json_integer_value(oversamplingJ);
+			oversampling = (factor >= 4) ? 4 : (factor >= 2) ? 2 : 1;
+		}
+
+		json_t* offloadJ = json_object_get(rootJ, "offload");
+		if (offloadJ)
+			offload = json_boolean_value(offloadJ);
+
+		json_t* offloadLatencyJ = json_object_get(rootJ, "offloadLatency");
+		if (offloadLatencyJ)
+			offloadLatency = clamp((int) json_integer_value(offloadLatencyJ), QuantumOffloadEngine::BLOCK, QuantumOffloadEngine::MAX_LATENCY);
+
+		json_t* tapeMinutesJ = json_object_get(rootJ, "tapeMinutes");
+		if (tapeMinutesJ)
+			tapeMinutes = clamp((int) json_integer_value(tapeMinutesJ), 0, 60);
+
+		// Restore quantum state into the engine that will be swapped in
+		QuantumEngineBase* newEngine = createQuantumEngine(taps, interp, format, oversampling);
+		float* probWeights = newEngine->getProbWeights();
+		float* targetWeights = newEngine->getTargetWeights();
 		json_t* weightsJ = json_object_get(rootJ, "probWeights");
 		if (weightsJ) {
-			for (int i = 0; i < NUM_BUFFERS; i++) {
+			for (int i = 0; i < newEngine->getTapCount(); i++) {
 				json_t* weightJ = json_array_get(weightsJ, i);
 				if (weightJ) {
 					probWeights[i] = json_real_value(weightJ);
@@ -336,6 +569,63 @@ struct QuantumSuperpositionDelay : Module {
 				}
 			}
 		}
+		tapCount = newEngine->getTapCount();
+		interpolation = newEngine->getInterpolation();
+		sampleFormat = newEngine->getSampleFormat();
+		attachTape(newEngine);
+		if (offload)
+			newEngine = new QuantumOffloadEngine(newEngine, offloadLatency);
+		finishLoading();
+		newestEngine = newEngine;
+		delete pendingEngine.exchange(newEngine);
+
+		json_t* panModeJ = json_object_get(rootJ, "panMode");
+		if (panModeJ)
+			panMode = clamp((int)json_integer_value(panModeJ), 0, PAN_MODES_LEN - 1);
+
+		json_t* midSideJ = json_object_get(rootJ, "midSide");
+		if (midSideJ)
+			midSide = json_boolean_value(midSideJ);
+
+		json_t* granularJ = json_object_get(rootJ, "granular");
+		if (granularJ)
+			granular = json_boolean_value(granularJ);
+
+		json_t* grainSizeJ = json_object_get(rootJ, "grainSize");
+		if (grainSizeJ)
+			grainSize = clamp((float) json_number_value(grainSizeJ), 0.f, 1.f);
+
+		json_t* grainDensityJ = json_object_get(rootJ, "grainDensity");
+		if (grainDensityJ)
+			grainDensity = clamp((float) json_number_value(grainDensityJ), 0.f, 1.f);
+
+		json_t* varispeedJ = json_object_get(rootJ, "varispeed");
+		if (varispeedJ)
+			varispeed = json_boolean_value(varispeedJ);
+
+		json_t* multibandJ = json_object_get(rootJ, "multiband");
+		if (multibandJ)
+			multiband = json_boolean_value(multibandJ);
+
+		json_t* spectralJ = json_object_get(rootJ, "spectral");
+		if (spectralJ)
+			spectral = json_boolean_value(spectralJ);
+
+		json_t* hardCollapseJ = json_object_get(rootJ, "hardCollapse");
+		if (hardCollapseJ)
+			hardCollapse = json_boolean_value(hardCollapseJ);
+
+		json_t* modShapeJ = json_object_get(rootJ, "modShape");
+		if (modShapeJ)
+			modShape = clamp((int)json_integer_value(modShapeJ), 0, LFO_SHAPES_LEN - 1);
+
+		json_t* stereoTapOutputsJ = json_object_get(rootJ, "stereoTapOutputs");
+		if (stereoTapOutputsJ)
+			stereoTapOutputs = json_boolean_value(stereoTapOutputsJ);
+
+		json_t* recordTapsJ = json_object_get(rootJ, "recordTaps");
+		if (recordTapsJ)
+			recordTaps = json_boolean_value(recordTapsJ);
 	}
 };
 
@@ -360,6 +650,7 @@ struct QuantumSuperpositionDelayWidget : ModuleWidget {
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(knobX, knobY + knobSpacing * 3)), module, QuantumSuperpositionDelay::FEEDBACK_PARAM));
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(knobX, knobY + knobSpacing * 3.7)), module, QuantumSuperpositionDelay::MIX_PARAM));
 		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(knobX, knobY + knobSpacing * 4.4)), module, QuantumSuperpositionDelay::CHAOS_PARAM));
+		addParam(createParamCentered<RoundBlackKnob>(mm2px(Vec(knobX, knobY + knobSpacing * 5.1)), module, QuantumSuperpositionDelay::WIDTH_PARAM));
 
 		// CV Inputs (right column)
 		float cvX = 40.f;
@@ -375,6 +666,28 @@ struct QuantumSuperpositionDelayWidget : ModuleWidget {
 		// Output
 		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(cvX, cvY + cvSpacing * 5.5)), module, QuantumSuperpositionDelay::AUDIO_OUTPUT));
 
+		// Right channel (stereo column)
+		float stereoX = 52.f;
+
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(stereoX, cvY)), module, QuantumSuperpositionDelay::AUDIO_R_INPUT));
+
+		// Freeze
+		addInput(createInputCentered<PJ301MPort>(mm2px(Vec(stereoX, cvY + cvSpacing)), module, QuantumSuperpositionDelay::FREEZE_INPUT));
+		addParam(createLightParamCentered<VCVLightLatch<MediumSimpleLight<WhiteLight>>>(mm2px(Vec(stereoX, cvY + cvSpacing * 2)), module, QuantumSuperpositionDelay::FREEZE_PARAM, QuantumSuperpositionDelay::FREEZE_LIGHT));
+		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(stereoX, cvY + cvSpacing * 5.5)), module, QuantumSuperpositionDelay::AUDIO_R_OUTPUT));
+
+		// Poly outputs
+		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(stereoX, cvY + cvSpacing * 3)), module, QuantumSuperpositionDelay::TAPS_OUTPUT));
+		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(stereoX, cvY + cvSpacing * 4)), module, QuantumSuperpositionDelay::WEIGHTS_OUTPUT));
+
+		// Feedback tone
+		addParam(createParamCentered<RoundSmallBlackKnob>(mm2px(Vec(cvX, cvY + cvSpacing * 7.5)), module, QuantumSuperpositionDelay::FEEDBACK_TONE_PARAM));
+		addParam(createParamCentered<RoundSmallBlackKnob>(mm2px(Vec(stereoX, cvY + cvSpacing * 7.5)), module, QuantumSuperpositionDelay::TONE_SPREAD_PARAM));
+
+		// Tap modulation
+		addParam(createParamCentered<RoundSmallBlackKnob>(mm2px(Vec(cvX, cvY + cvSpacing * 8.5)), module, QuantumSuperpositionDelay::MOD_DEPTH_PARAM));
+		addParam(createParamCentered<RoundSmallBlackKnob>(mm2px(Vec(stereoX, cvY + cvSpacing * 8.5)), module, QuantumSuperpositionDelay::MOD_RATE_PARAM));
+
 		// Lights
 		float lightX = 40.f;
 		float lightY = 160.f;
@@ -382,10 +695,387 @@ struct QuantumSuperpositionDelayWidget : ModuleWidget {
 
 		addChild(createLightCentered<MediumLight<RedLight>>(mm2px(Vec(lightX, lightY)), module, QuantumSuperpositionDelay::COLLAPSE_LIGHT));
 		
-		for (int i = 0; i < QuantumSuperpositionDelay::NUM_BUFFERS; i++) {
+		for (int i = 0; i < QuantumSuperpositionDelay::NUM_LIGHTS; i++) {
 			addChild(createLightCentered<SmallLight<BlueLight>>(mm2px(Vec(lightX + (i % 3) * lightSpacing, lightY + 10.f + (i / 3) * lightSpacing)), module, QuantumSuperpositionDelay::BUFFER_LIGHT_1 + i));
 		}
 	}
+
+	void step() override {
+		QuantumSuperpositionDelay* module = getModule<QuantumSuperpositionDelay>();
+		if (module) {
+			// Engines and histories replaced on the audio thread are freed here. A sample
+			// loader only uses the newest engine, which is never among them.
+			module->collectLoader(false);
+			delete module->retiredEngine.exchange(nullptr);
+			delete module->retiredHistory.exchange(nullptr);
+			// Spectral mode's frames are allocated the first time it is switched on
+			if (module->spectral)
+				module->newestEngine->prepareSpectral();
+		}
+		ModuleWidget::step();
+	}
+
+	void appendContextMenu(Menu* menu) override {
+		QuantumSuperpositionDelay* module = getModule<QuantumSuperpositionDelay>();
+
+		menu->addChild(new MenuSeparator);
+		menu->addChild(createMenuLabel("Engine"));
+
+		std::vector<std::string> tapLabels;
+		for (int i = 0; i < QUANTUM_TAP_COUNTS_LEN; i++) {
+			tapLabels.push_back(string::f("%d", QUANTUM_TAP_COUNTS[i]));
+		}
+		menu->addChild(createIndexSubmenuItem("Taps", tapLabels,
+			[=]() {
+				for (int i = 0; i < QUANTUM_TAP_COUNTS_LEN; i++) {
+					if (QUANTUM_TAP_COUNTS[i] == module->tapCount)
+						return (size_t)i;
+				}
+				return (size_t)0;
+			},
+			[=](size_t i) {
+				module->setEngineConfig(QUANTUM_TAP_COUNTS[i], module->interpolation, module->sampleFormat);
+			}
+		));
+		menu->addChild(createIndexSubmenuItem("Interpolation", {"Linear", "Cubic (Hermite)"},
+			[=]() {return (size_t)module->interpolation;},
+			[=](size_t i) {module->setEngineConfig(module->tapCount, i, module->sampleFormat);}
+		));
+		menu->addChild(createIndexSubmenuItem("Delay memory", {"32-bit float", "16-bit half (half memory)"},
+			[=]() {return (size_t)module->sampleFormat;},
+			[=](size_t i) {module->setEngineConfig(module->tapCount, module->interpolation, i);}
+		));
+		static const int oversamplingFactors[] = {1, 2, 4};
+		menu->addChild(createIndexSubmenuItem("Oversampling", {"Off", "2x", "4x"},
+			[=]() {
+				for (size_t i = 0; i < 3; i++) {
+					if (oversamplingFactors[i] == module->oversampling)
+						return i;
+				}
+				return (size_t)0;
+			},
+			[=](size_t i) {
+				module->oversampling = oversamplingFactors[i];
+				module->setEngineConfig(module->tapCount, module->interpolation, module->sampleFormat);
+			}
+		));
+		menu->addChild(createSubmenuItem("Worker thread offload", module->offload ? "On" : "", [=](Menu* menu) {
+			menu->addChild(createBoolMenuItem("Render on a worker thread", "",
+				[=]() {return module->offload;},
+				[=](bool offload) {
+					module->offload = offload;
+					module->setEngineConfig(module->tapCount, module->interpolation, module->sampleFormat);
+				}
+			));
+			static const int latencies[] = {256, 512, 1024, 2048};
+			std::vector<std::string> latencyLabels;
+			for (int latency : latencies)
+				latencyLabels.push_back(string::f("%d frames", latency));
+			menu->addChild(createIndexSubmenuItem("Latency", latencyLabels,
+				[=]() {
+					for (size_t i = 0; i < latencyLabels.size(); i++) {
+						if (latencies[i] == module->offloadLatency)
+							return i;
+					}
+					return (size_t)2;
+				},
+				[=](size_t i) {
+					module->offloadLatency = latencies[i];
+					if (module->offload)
+						module->setEngineConfig(module->tapCount, module->interpolation, module->sampleFormat);
+				}
+			));
+			// Counters of the engine running now; a pending swap has not started yet
+			QuantumOffloadEngine* offloaded = dynamic_cast<QuantumOffloadEngine*>(module->engine);
+			if (offloaded) {
+				menu->addChild(createMenuLabel(string::f("Wet path %d frames late", offloaded->getLatency())));
+				menu->addChild(createMenuLabel(string::f("%u late frames played dry, %u blocks dropped",
+					offloaded->lateFrames.load(), offloaded->droppedBlocks.load())));
+			}
+		}));
+
+		static const int tapeLengths[] = {0, 1, 2, 5, 10};
+		menu->addChild(createSubmenuItem("Tape mode (minutes of history)", module->tapeMinutes ? string::f("%d min", module->tapeMinutes) : "", [=](Menu* menu) {
+			menu->addChild(createIndexSubmenuItem("Tape length", {"Off", "1 minute", "2 minutes", "5 minutes", "10 minutes"},
+				[=]() {
+					for (size_t i = 0; i < 5; i++) {
+						if (tapeLengths[i] == module->tapeMinutes)
+							return i;
+					}
+					return (size_t)0;
+				},
+				[=](size_t i) {
+					module->tapeMinutes = tapeLengths[i];
+					module->setEngineConfig(module->tapCount, module->interpolation, module->sampleFormat);
+				}
+			));
+			// Pages of the tape running now that a tap or the write head reached before the prefetcher
+			QuantumTape* tape = module->newestEngine->getTape();
+			if (tape) {
+				menu->addChild(createMenuLabel(string::f("%.1f minutes on %s", tape->size / (60.f * APP->engine->getSampleRate() * module->oversampling), tape->mapped ? "disk" : "the heap")));
+				menu->addChild(createMenuLabel(string::f("%u late pages", tape->latePages.load())));
+			}
+		}));
+		// The file's last moments fill the history, as if it had just played through the module
+		menu->addChild(createMenuItem("Load sample into history...", module->loading() ? "loading..." : module->sampleName, [=]() {
+			osdialog_filters* filters = osdialog_filters_parse("WAV:wav");
+			char* path = osdialog_file(OSDIALOG_OPEN, NULL, NULL, filters);
+			osdialog_filters_free(filters);
+			if (path) {
+				module->loadSample(path);
+				std::free(path);
+			}
+		}));
+		if (!module->sampleError.empty())
+			menu->addChild(createMenuLabel(module->sampleError));
+		menu->addChild(createBoolPtrMenuItem("Variable-speed taps (chaos assigns speeds)", "", &module->varispeed));
+		menu->addChild(createBoolPtrMenuItem("Multiband (low, mid and high collapse apart)", "", &module->multiband));
+		// Both in frames of the engine's rate. Taps set longer than the cap play at it.
+		float engineRate = APP->engine->getSampleRate() * module->oversampling;
+		float spectralMs = QUANTUM_SPECTRAL_SIZE * 1000.f / engineRate;
+		float spectralMaxMs = QUANTUM_SPECTRAL_MAX_DELAY * 1000.f / engineRate;
+		menu->addChild(createBoolPtrMenuItem("Spectral superposition (per-bin collapse)", string::f("+%.1f ms wet latency, taps up to %.0f ms", spectralMs, spectralMaxMs), &module->spectral));
+		menu->addChild(createBoolPtrMenuItem("Hard collapse (weights snap instead of gliding)", "", &module->hardCollapse));
+		menu->addChild(createIndexPtrSubmenuItem("Tap modulation shape", {"Sine", "Triangle", "Filtered noise"}, &module->modShape));
+
+		menu->addChild(new MenuSeparator);
+		menu->addChild(createMenuLabel("Grains"));
+		menu->addChild(createBoolPtrMenuItem("Grain cloud read mode", "", &module->granular));
+
+		// Five steps across each control's range
+		std::vector<std::string> sizeLabels;
+		std::vector<std::string> densityLabels;
+		for (int i = 0; i < 5; i++) {
+			sizeLabels.push_back(string::f("%.0f ms", quantumGrainMs(i / 4.f)));
+			densityLabels.push_back(string::f("%.0f per second", quantumGrainRate(i / 4.f)));
+		}
+		menu->addChild(createIndexSubmenuItem("Grain size", sizeLabels,
+			[=]() {return (size_t)std::round(module->grainSize * 4.f);},
+			[=](size_t i) {module->grainSize = i / 4.f;}
+		));
+		menu->addChild(createIndexSubmenuItem("Grain density (per tap)", densityLabels,
+			[=]() {return (size_t)std::round(module->grainDensity * 4.f);},
+			[=](size_t i) {module->grainDensity = i / 4.f;}
+		));
+
+		menu->addChild(new MenuSeparator);
+		menu->addChild(createMenuLabel("Stereo"));
+		menu->addChild(createIndexPtrSubmenuItem("Tap panning", {"Static", "Follow probability weights", "Chaos drift"}, &module->panMode));
+		menu->addChild(createBoolPtrMenuItem("Mid/side processing", "", &module->midSide));
+		menu->addChild(createBoolPtrMenuItem("Stereo tap outputs (L/R interleaved)", "", &module->stereoTapOutputs));
+
+		menu->addChild(new MenuSeparator);
+		menu->addChild(createMenuLabel("Recorder"));
+		menu->addChild(createBoolMenuItem("Record to disk", "",
+			[=]() {return module->recorder.isRecording();},
+			[=](bool record) {
+				if (record)
+					module->startRecording();
+				else
+					module->recorder.stop();
+			}
+		));
+		menu->addChild(createBoolPtrMenuItem("Include per-tap channels", "from the next take", &module->recordTaps));
+		if (!module->recorderError.empty()) {
+			menu->addChild(createMenuLabel(module->recorderError));
+		} else if (module->recorder.isRecording() || module->recorder.recordedFrames.load() > 0) {
+			// Counters of the current or last take
+			menu->addChild(createMenuLabel(system::getFilename(module->recorder.path)));
+			menu->addChild(createMenuLabel(string::f("%.1f s written, %u blocks dropped%s",
+				module->recorder.recordedFrames.load() / (double) module->recorder.sampleRate,
+				module->recorder.droppedBlocks.load(), module->recorder.failed.load() ? ", write failed" : "")));
+		}
+
+#ifdef QSD_PROFILE
+		menu->addChild(new MenuSeparator);
+		menu->addChild(createSubmenuItem("Profile (cycles per call)", "", [=](Menu* menu) {
+			if (module->offload)
+				menu->addChild(createMenuLabel("Engine stages run on the offload worker, not profiled"));
+			for (int s = 0; s < PROFILE_STAGES_LEN; s++) {
+				QuantumProfiler::Summary summary = module->profiler.summarize(s);
+				menu->addChild(createMenuLabel(string::f("%s: mean %.0f, p50 < %llu, p99 < %llu, %.1f%%",
+					QUANTUM_PROFILE_STAGE_NAMES[s], summary.mean, (unsigned long long) summary.p50, (unsigned long long) summary.p99, summary.share * 100.0)));
+			}
+			menu->addChild(createMenuItem("Reset", "", [=]() {
+				module->profiler.resetRequested = true;
+			}));
+		}));
+#endif
+	}
 };
 
 Model* modelQuantumSuperpositionDelay = createModel<QuantumSuperpositionDelay, QuantumSuperpositionDelayWidget>("QuantumSuperpositionDelay");
+
+
+struct QuantumSuperpositionBank : Module {
+	enum ParamId {
+		PARAMS_LEN
+	};
+	enum InputId {
+		INPUTS_LEN
+	};
+	enum OutputId {
+		AUDIO_OUTPUT,
+		AUDIO_R_OUTPUT,
+		OUTPUTS_LEN
+	};
+	enum LightId {
+		LINK_LIGHT,
+		BUFFER_LIGHT_1,
+		BUFFER_LIGHT_2,
+		BUFFER_LIGHT_3,
+		BUFFER_LIGHT_4,
+		BUFFER_LIGHT_5,
+		BUFFER_LIGHT_6,
+		FREEZE_LIGHT,
+		LIGHTS_LEN
+	};
+
+	static constexpr int NUM_BUFFERS = QUANTUM_BANK_TAPS;
+	static constexpr int NUM_GROUPS = NUM_BUFFERS / 2;
+
+	// Double buffers for messages from the left (history) and right (bank audio)
+	QuantumBankMessage bankMessages[2];
+	QuantumBankReturn bankReturns[2];
+
+	dsp::ClockDivider lightDivider;
+
+	QuantumSuperpositionBank() {
+		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
+
+		configOutput(AUDIO_OUTPUT, "Bank Left/Mono Audio");
+		configOutput(AUDIO_R_OUTPUT, "Bank Right Audio");
+
+		configLight(LINK_LIGHT, "Linked to Quantum Superposition Delay");
+		for (int i = 0; i < NUM_BUFFERS; i++) {
+			configLight(BUFFER_LIGHT_1 + i, string::f("Buffer %d Activity", i + 1));
+		}
+		configLight(FREEZE_LIGHT, "Frozen");
+
+		leftExpander.producerMessage = &bankMessages[0];
+		leftExpander.consumerMessage = &bankMessages[1];
+		rightExpander.producerMessage = &bankReturns[0];
+		rightExpander.consumerMessage = &bankReturns[1];
+
+		lightDivider.setDivision(64);
+	}
+
+	template <typename TSample>
+	float_4 readBank(const TSample* history, const QuantumBankMessage* message, int bank) {
+		int bufferSize = message->bufferSize;
+		size_t stride = (size_t)bufferSize * 2;
+
+		// The message is `hop` host frames old on arrival and the result takes `hop` frames to
+		// reach the main module, then the engine's return delay to be mixed, so read that much
+		// later to keep the tap times exact. Stay clear of the frames the main module is
+		// writing concurrently. All in history frames, which oversampling makes shorter.
+		int hopFrames = message->hop * message->oversampling;
+		float latency = 2.f * hopFrames + message->returnDelay;
+		float minDelay = latency + hopFrames + 2.f;
+
+		float_4 outputAccumulator = 0.f;
+		for (int g = 0; g < NUM_GROUPS; g++) {
+			int a = g * 2;
+			int b = a + 1;
+			float delayA = std::max(message->delayTimes[bank * NUM_BUFFERS + a], minDelay);
+			float delayB = std::max(message->delayTimes[bank * NUM_BUFFERS + b], minDelay);
+			float posA = wrapPosition(message->writeIndex + latency - delayA, bufferSize);
+			float posB = wrapPosition(message->writeIndex + latency - delayB, bufferSize);
+
+			// Bank tap i reads main buffer i, wrapping when the main engine has fewer taps
+			const TSample* bufferA = &history[(a % message->bufferCount) * stride];
+			const TSample* bufferB = &history[(b % message->bufferCount) * stride];
+			float_4 delayedSample = LinearInterpolator::read(bufferA, posA, bufferB, posB, bufferSize);
+			// Mute history the main engine has not recovered yet
+			delayedSample = simd::ifelse(simd::fabs(delayedSample) <= QUANTUM_FAULT_LIMIT, delayedSample, 0.f);
+
+			outputAccumulator += delayedSample * message->mixGains[bank * NUM_GROUPS + g];
+		}
+		return outputAccumulator;
+	}
+
+	void process(const ProcessArgs& args) override {
+		Module* left = leftExpander.module;
+		bool linked = left && (left->model == modelQuantumSuperpositionDelay || left->model == modelQuantumSuperpositionBank);
+		const QuantumBankMessage* message = (const QuantumBankMessage*) leftExpander.consumerMessage;
+		linked = linked && message->delayBuffers;
+
+		bool active = linked && message->hop <= QUANTUM_MAX_BANKS;
+		int bank = active ? message->hop - 1 : 0;
+		float wetL = 0.f;
+		float wetR = 0.f;
+
+		if (active) {
+			float_4 outputAccumulator;
+			if (message->sampleFormat == SAMPLE_HALF)
+				outputAccumulator = readBank((const Half*) message->delayBuffers, message, bank);
+			else
+				outputAccumulator = readBank((const float*) message->delayBuffers, message, bank);
+
+			wetL = outputAccumulator[0] + outputAccumulator[2];
+			wetR = outputAccumulator[1] + outputAccumulator[3];
+		}
+
+		// Forward the history to the next bank
+		Module* right = rightExpander.module;
+		bool chained = right && right->model == modelQuantumSuperpositionBank;
+		if (chained && linked) {
+			QuantumBankMessage* next = (QuantumBankMessage*) right->leftExpander.producerMessage;
+			*next = *message;
+			next->hop = message->hop + 1;
+			right->leftExpander.requestMessageFlip();
+		}
+
+		// Return this bank plus everything to its right
+		if (linked) {
+			QuantumBankReturn* ret = (QuantumBankReturn*) left->rightExpander.producerMessage;
+			const QuantumBankReturn* fromRight = (const QuantumBankReturn*) rightExpander.consumerMessage;
+			ret->bankCount = active ? 1 : 0;
+			ret->wetL = wetL;
+			ret->wetR = wetR;
+			if (chained && active) {
+				ret->bankCount += fromRight->bankCount;
+				ret->wetL += fromRight->wetL;
+				ret->wetR += fromRight->wetR;
+			}
+			left->rightExpander.requestMessageFlip();
+		}
+
+		outputs[AUDIO_OUTPUT].setVoltage(clamp(wetL, -10.f, 10.f));
+		outputs[AUDIO_R_OUTPUT].setVoltage(clamp(wetR, -10.f, 10.f));
+
+		if (lightDivider.process()) {
+			lights[LINK_LIGHT].setBrightness(active ? 1.f : 0.f);
+			for (int i = 0; i < NUM_BUFFERS; i++) {
+				lights[BUFFER_LIGHT_1 + i].setBrightness(active ? message->weights[bank * NUM_BUFFERS + i] : 0.f);
+			}
+			lights[FREEZE_LIGHT].setBrightness(active && message->frozen ? 1.f : 0.f);
+		}
+	}
+};
+
+struct QuantumSuperpositionBankWidget : ModuleWidget {
+	QuantumSuperpositionBankWidget(QuantumSuperpositionBank* module) {
+		setModule(module);
+		setPanel(createPanel(asset::plugin(pluginInstance, "res/QuantumSuperpositionBank.svg")));
+
+		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH, 0)));
+		addChild(createWidget<ScrewSilver>(Vec(RACK_GRID_WIDTH, RACK_GRID_HEIGHT - RACK_GRID_WIDTH)));
+
+		float centerX = 7.62f;
+
+		addChild(createLightCentered<SmallLight<GreenLight>>(mm2px(Vec(centerX, 20.f)), module, QuantumSuperpositionBank::LINK_LIGHT));
+
+		for (int i = 0; i < QuantumSuperpositionBank::NUM_BUFFERS; i++) {
+			addChild(createLightCentered<SmallLight<BlueLight>>(mm2px(Vec(centerX, 35.f + i * 6.f)), module, QuantumSuperpositionBank::BUFFER_LIGHT_1 + i));
+		}
+
+		// Follows the main module's freeze, as the bank replays the same held history
+		addChild(createLightCentered<SmallLight<WhiteLight>>(mm2px(Vec(centerX, 80.f)), module, QuantumSuperpositionBank::FREEZE_LIGHT));
+
+		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(centerX, 96.f)), module, QuantumSuperpositionBank::AUDIO_OUTPUT));
+		addOutput(createOutputCentered<PJ301MPort>(mm2px(Vec(centerX, 110.f)), module, QuantumSuperpositionBank::AUDIO_R_OUTPUT));
+	}
+};
+
+Model* modelQuantumSuperpositionBank = createModel<QuantumSuperpositionBank, QuantumSuperpositionBankWidget>("QuantumSuperpositionBank");
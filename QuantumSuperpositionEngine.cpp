@@ -0,0 +1,55 @@
+#include "QuantumSuperpositionEngine.hpp"
+#include "QuantumOversample.hpp"
+
+template struct QuantumEngine<4, LinearInterpolator, float>;
+template struct QuantumEngine<4, LinearInterpolator, Half>;
+template struct QuantumEngine<4, CubicInterpolator, float>;
+template struct QuantumEngine<4, CubicInterpolator, Half>;
+template struct QuantumEngine<6, LinearInterpolator, float>;
+template struct QuantumEngine<6, LinearInterpolator, Half>;
+template struct QuantumEngine<6, CubicInterpolator, float>;
+template struct QuantumEngine<6, CubicInterpolator, Half>;
+template struct QuantumEngine<8, LinearInterpolator, float>;
+template struct QuantumEngine<8, LinearInterpolator, Half>;
+template struct QuantumEngine<8, CubicInterpolator, float>;
+template struct QuantumEngine<8, CubicInterpolator, Half>;
+template struct QuantumEngine<16, LinearInterpolator, float>;
+template struct QuantumEngine<16, LinearInterpolator, Half>;
+template struct QuantumEngine<16, CubicInterpolator, float>;
+template struct QuantumEngine<16, CubicInterpolator, Half>;
+
+template <int TAPS>
+static QuantumEngineBase* createQuantumEngineTaps(int interpolation, int sampleFormat, int oversampling) {
+	if (interpolation == INTERP_CUBIC) {
+		if (sampleFormat == SAMPLE_HALF)
+			return new QuantumEngine<TAPS, CubicInterpolator, Half>(oversampling);
+		return new QuantumEngine<TAPS, CubicInterpolator, float>(oversampling);
+	}
+	if (sampleFormat == SAMPLE_HALF)
+		return new QuantumEngine<TAPS, LinearInterpolator, Half>(oversampling);
+	return new QuantumEngine<TAPS, LinearInterpolator, float>(oversampling);
+}
+
+QuantumBufferPool& quantumBufferPool() {
+	static QuantumBufferPool pool;
+	return pool;
+}
+
+const QuantumLfoTable& quantumLfoTable() {
+	static QuantumLfoTable table;
+	return table;
+}
+
+QuantumEngineBase* createQuantumEngine(int taps, int interpolation, int sampleFormat, int oversampling) {
+	oversampling = (oversampling >= 4) ? 4 : (oversampling >= 2) ? 2 : 1;
+	QuantumEngineBase* engine;
+	switch (taps) {
+		case 4: engine = createQuantumEngineTaps<4>(interpolation, sampleFormat, oversampling); break;
+		case 8: engine = createQuantumEngineTaps<8>(interpolation, sampleFormat, oversampling); break;
+		case 16: engine = createQuantumEngineTaps<16>(interpolation, sampleFormat, oversampling); break;
+		default: engine = createQuantumEngineTaps<6>(interpolation, sampleFormat, oversampling); break;
+	}
+	if (oversampling > 1)
+		engine = new QuantumOversampledEngine(engine, oversampling);
+	return engine;
+}
@@ -0,0 +1,1894 @@
+#pragma once
+#include <rack.hpp>
+#include <functional>
+#include <random>
+#include <vector>
+
+#include "QuantumBufferPool.hpp"
+#include "QuantumProfile.hpp"
+#include "QuantumSpectral.hpp"
+#include "QuantumTape.hpp"
+
+using namespace rack;
+using simd::float_4;
+
+static constexpr int QUANTUM_BANK_TAPS = 6;
+static constexpr int QUANTUM_MAX_BANKS = 3;
+// Any history sample beyond this has gone non-finite or run away
+static constexpr float QUANTUM_FAULT_LIMIT = 1000.f;
+
+enum QuantumPanMode {
+	PAN_STATIC,
+	PAN_WEIGHTS,
+	PAN_CHAOS,
+	PAN_MODES_LEN
+};
+
+enum QuantumInterpolation {
+	INTERP_LINEAR,
+	INTERP_CUBIC,
+	INTERP_LEN
+};
+
+enum QuantumSampleFormat {
+	SAMPLE_FLOAT,
+	SAMPLE_HALF,
+	SAMPLE_FORMATS_LEN
+};
+
+// Tap counts with an explicit engine instantiation
+static const int QUANTUM_TAP_COUNTS[] = {4, 6, 8, 16};
+static constexpr int QUANTUM_TAP_COUNTS_LEN = 4;
+
+// Main module -> expander chain, forwarded bank to bank.
+// The history is shared zero-copy: expanders read the main module's buffers directly.
+struct QuantumBankMessage {
+	const void* delayBuffers = nullptr; // [tap][frame][L/R], see sampleFormat
+	int sampleFormat = SAMPLE_FLOAT;
+	int bufferCount = 0;
+	int bufferSize = 0;
+	int writeIndex = 0; // frame written by the main module when the message was produced
+	int hop = 0; // 1 for the bank next to the main module
+	// History frames per host frame, so hops can be timed in history frames
+	int oversampling = 1;
+	// History frames the returned bank audio spends in the main engine before it is mixed
+	int returnDelay = 0;
+	bool frozen = false; // the history is held, so the banks replay it too
+	float weights[QUANTUM_MAX_BANKS * QUANTUM_BANK_TAPS] = {};
+	float delayTimes[QUANTUM_MAX_BANKS * QUANTUM_BANK_TAPS] = {};
+	float_4 mixGains[QUANTUM_MAX_BANKS * QUANTUM_BANK_TAPS / 2] = {};
+};
+
+// Expander chain -> main module, accumulated bank to bank
+struct QuantumBankReturn {
+	int bankCount = 0;
+	float wetL = 0.f;
+	float wetR = 0.f;
+};
+
+// IEEE 754 binary16 delay storage: half the memory at ~66 dB resolution.
+// Rounds to nearest even, saturates at the largest finite value.
+struct Half {
+	uint16_t bits = 0;
+
+	Half() {}
+	Half(float f) : bits(fromFloat(f)) {}
+	operator float() const {
+		return toFloat(bits);
+	}
+
+	static uint16_t fromFloat(float f) {
+		uint32_t x;
+		std::memcpy(&x, &f, 4);
+		uint32_t sign = x & 0x80000000u;
+		x ^= sign;
+
+		uint16_t h;
+		if (x >= 0x477fe000u) {
+			// Overflow (or NaN), saturate
+			h = 0x7bff;
+		} else if (x < 0x38800000u) {
+			// Subnormal, let the FPU do the rounding
+			float g;
+			std::memcpy(&g, &x, 4);
+			g += 0.5f;
+			uint32_t y;
+			std::memcpy(&y, &g, 4);
+			h = y - 0x3f000000u;
+		} else {
+			uint32_t mantOdd = (x >> 13) & 1;
+			x += ((uint32_t)(15 - 127) << 23) + 0xfff;
+			x += mantOdd;
+			h = x >> 13;
+		}
+		return h | (sign >> 16);
+	}
+
+	static float toFloat(uint16_t h) {
+		uint32_t x = (uint32_t)(h & 0x7fff) << 13;
+		float f;
+		std::memcpy(&f, &x, 4);
+		f *= 5.192296858534828e33f; // 2^112 rebiases the exponent and handles subnormals
+		std::memcpy(&x, &f, 4);
+		x |= (uint32_t)(h & 0x8000) << 16;
+		std::memcpy(&f, &x, 4);
+		return f;
+	}
+};
+
+template <typename TSample>
+struct QuantumSampleTraits;
+
+template <>
+struct QuantumSampleTraits<float> {
+	static constexpr int FORMAT = SAMPLE_FLOAT;
+};
+
+template <>
+struct QuantumSampleTraits<Half> {
+	static constexpr int FORMAT = SAMPLE_HALF;
+};
+
+// Loads frame `ia` of buffer A and frame `ib` of buffer B as {A L, A R, B L, B R}
+template <typename TSample>
+inline float_4 loadTapPair(const TSample* bufferA, int ia, const TSample* bufferB, int ib) {
+	const TSample* frameA = &bufferA[ia * 2];
+	const TSample* frameB = &bufferB[ib * 2];
+	return float_4(frameA[0], frameA[1], frameB[0], frameB[1]);
+}
+
+template <typename TSample>
+inline void storeTapPair(TSample* bufferA, int ia, TSample* bufferB, int ib, float_4 v) {
+	TSample* frameA = &bufferA[ia * 2];
+	TSample* frameB = &bufferB[ib * 2];
+	frameA[0] = v[0];
+	frameA[1] = v[1];
+	frameB[0] = v[2];
+	frameB[1] = v[3];
+}
+
+inline int wrapIndex(int i, int size) {
+	if (i >= size)
+		i -= size;
+	if (i < 0)
+		i += size;
+	return i;
+}
+
+// Wraps a fractional frame into [0, size). A tiny negative position plus size rounds up
+// to size itself in float, which would read one frame past the buffer.
+inline float wrapPosition(float x, int size) {
+	if (x >= size)
+		x -= size;
+	if (x < 0.f)
+		x += size;
+	return (x < size) ? x : 0.f;
+}
+
+struct LinearInterpolator {
+	static constexpr float MIN_DELAY = 1.f;
+
+	// Positions are fractional frames in [0, size)
+	template <typename TSample>
+	static float_4 read(const TSample* bufferA, float posA, const TSample* bufferB, float posB, int size) {
+		int readA = (int)posA;
+		int readB = (int)posB;
+		float fracA = posA - readA;
+		float fracB = posB - readB;
+
+		float_4 x0 = loadTapPair(bufferA, readA, bufferB, readB);
+		float_4 x1 = loadTapPair(bufferA, wrapIndex(readA + 1, size), bufferB, wrapIndex(readB + 1, size));
+		return x0 + (x1 - x0) * float_4(fracA, fracA, fracB, fracB);
+	}
+};
+
+struct CubicInterpolator {
+	// Needs one frame beyond the read position
+	static constexpr float MIN_DELAY = 2.f;
+
+	// 4-point, 3rd-order Hermite
+	template <typename TSample>
+	static float_4 read(const TSample* bufferA, float posA, const TSample* bufferB, float posB, int size) {
+		int readA = (int)posA;
+		int readB = (int)posB;
+		float fracA = posA - readA;
+		float fracB = posB - readB;
+
+		float_4 xm1 = loadTapPair(bufferA, wrapIndex(readA - 1, size), bufferB, wrapIndex(readB - 1, size));
+		float_4 x0 = loadTapPair(bufferA, readA, bufferB, readB);
+		float_4 x1 = loadTapPair(bufferA, wrapIndex(readA + 1, size), bufferB, wrapIndex(readB + 1, size));
+		float_4 x2 = loadTapPair(bufferA, wrapIndex(readA + 2, size), bufferB, wrapIndex(readB + 2, size));
+
+		float_4 t(fracA, fracA, fracB, fracB);
+		float_4 c1 = 0.5f * (x1 - xm1);
+		float_4 c2 = xm1 - 2.5f * x0 + 2.f * x1 - 0.5f * x2;
+		float_4 c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+		return ((c3 * t + c2) * t + c1) * t + x0;
+	}
+};
+
+// Live grains per engine in granular mode, a multiple of 4
+static constexpr int QUANTUM_GRAIN_CAPACITY = 512;
+static constexpr int QUANTUM_GRAIN_WINDOW_SIZE = 256;
+
+// C++11 stand-in for std::index_sequence
+template <int... I>
+struct QuantumIndexList {};
+
+template <int N, int... I>
+struct QuantumMakeIndexList : QuantumMakeIndexList<N - 1, N - 1, I...> {};
+
+template <int... I>
+struct QuantumMakeIndexList<0, I...> {
+	typedef QuantumIndexList<I...> type;
+};
+
+// sin(x) for |x| <= pi/2, Taylor series to x^11, error below 1e-7
+constexpr double quantumSinPoly(double x, double x2) {
+	return x * (1 - x2 / 6 * (1 - x2 / 20 * (1 - x2 / 42 * (1 - x2 / 72 * (1 - x2 / 110)))));
+}
+
+constexpr double quantumSquare(double x) {
+	return x * x;
+}
+
+// Hann window sin^2(pi i / n), folded onto the quarter period the series covers
+constexpr float quantumHann(int i, int n) {
+	return (float) quantumSquare(quantumSinPoly(M_PI / 2 - M_PI * (i * 2 > n ? i - n / 2.0 : n / 2.0 - i) / n,
+		quantumSquare(M_PI / 2 - M_PI * (i * 2 > n ? i - n / 2.0 : n / 2.0 - i) / n)));
+}
+
+template <typename TList>
+struct QuantumGrainWindowTable;
+
+template <int... I>
+struct QuantumGrainWindowTable<QuantumIndexList<I...>> {
+	static constexpr float values[sizeof...(I)] = {quantumHann(I, sizeof...(I) - 1)...};
+};
+
+template <int... I>
+constexpr float QuantumGrainWindowTable<QuantumIndexList<I...>>::values[sizeof...(I)];
+
+// Grain envelope shared by every engine, built at compile time. The last entry closes the
+// window so interpolation at the end of a grain never reads past the table.
+typedef QuantumGrainWindowTable<QuantumMakeIndexList<QUANTUM_GRAIN_WINDOW_SIZE + 1>::type> QuantumGrainWindow;
+
+// Per-tap delay modulation
+enum QuantumLfoShape {
+	LFO_SINE,
+	LFO_TRIANGLE,
+	LFO_NOISE,
+	LFO_SHAPES_LEN
+};
+
+static constexpr int QUANTUM_LFO_SIZE = 1024;
+static constexpr float QUANTUM_MOD_MAX_MS = 5.f; // deepest sweep, peak to peak
+
+// One period of each LFO shape, -1 to 1, shared by every engine. Each shape is a sum of its
+// first HARMONICS harmonics, so even the triangle's corners and the noise stay smooth at
+// audio-rate sweeps. The last entry repeats the first so interpolation never wraps.
+struct QuantumLfoTable {
+	static constexpr int HARMONICS = 16;
+
+	float values[LFO_SHAPES_LEN][QUANTUM_LFO_SIZE + 1];
+
+	QuantumLfoTable() {
+		// Filtered noise: harmonics at random phases with a 1/f spectrum, fixed for every run
+		std::mt19937 rng(0x1f0);
+		float noisePhases[HARMONICS];
+		for (int h = 0; h < HARMONICS; h++)
+			noisePhases[h] = 2.f * M_PI * (rng() / 4294967296.f);
+
+		for (int i = 0; i < QUANTUM_LFO_SIZE; i++) {
+			float x = 2.f * M_PI * i / QUANTUM_LFO_SIZE;
+			float triangle = 0.f;
+			float noise = 0.f;
+			for (int h = 1; h <= HARMONICS; h++) {
+				if (h % 2)
+					triangle += ((h / 2) % 2 ? -1.f : 1.f) * std::sin(h * x) / (h * h);
+				noise += std::sin(h * x + noisePhases[h - 1]) / h;
+			}
+			values[LFO_SINE][i] = std::sin(x);
+			values[LFO_TRIANGLE][i] = triangle;
+			values[LFO_NOISE][i] = noise;
+		}
+		// Stretched to span exactly -1 to 1, the noise is not symmetric
+		for (int shape = 0; shape < LFO_SHAPES_LEN; shape++) {
+			float low = values[shape][0];
+			float high = values[shape][0];
+			for (int i = 1; i < QUANTUM_LFO_SIZE; i++) {
+				low = std::min(low, values[shape][i]);
+				high = std::max(high, values[shape][i]);
+			}
+			for (int i = 0; i < QUANTUM_LFO_SIZE; i++)
+				values[shape][i] = (2.f * values[shape][i] - high - low) / (high - low);
+			values[shape][QUANTUM_LFO_SIZE] = values[shape][0];
+		}
+	}
+};
+
+const QuantumLfoTable& quantumLfoTable();
+
+// 0-1 to 0.05-10 Hz
+inline float quantumModRate(float rate) {
+	return 0.05f * std::pow(200.f, rate);
+}
+
+// Multiband mode: bands {low, mid, high} split by 4th-order Linkwitz-Riley crossovers
+static constexpr int QUANTUM_BANDS = 3;
+static constexpr float QUANTUM_CROSSOVER_LOW = 250.f;
+static constexpr float QUANTUM_CROSSOVER_HIGH = 2500.f;
+
+enum QuantumBiquadType {
+	BIQUAD_THROUGH,
+	BIQUAD_LOWPASS,
+	BIQUAD_HIGHPASS,
+	BIQUAD_ALLPASS
+};
+
+// Four independent biquads, one per lane, transposed direct form II
+struct QuantumBiquad4 {
+	float_4 b0 = 1.f;
+	float_4 b1 = 0.f;
+	float_4 b2 = 0.f;
+	float_4 a1 = 0.f;
+	float_4 a2 = 0.f;
+	float_4 s1 = 0.f;
+	float_4 s2 = 0.f;
+
+	// Butterworth Q, two in cascade make a Linkwitz-Riley section (RBJ cookbook)
+	void setLane(int lane, int type, float frequency, float sampleRate) {
+		float w0 = 2.f * M_PI * clamp(frequency / sampleRate, 1e-5f, 0.49f);
+		float cosW0 = std::cos(w0);
+		float alpha = std::sin(w0) / (2.f * M_SQRT1_2);
+		float a0 = 1.f + alpha;
+		float c[5] = {1.f, 0.f, 0.f, 0.f, 0.f}; // b0 b1 b2 a1 a2
+		switch (type) {
+			case BIQUAD_LOWPASS: {
+				c[0] = (1.f - cosW0) * 0.5f / a0;
+				c[1] = (1.f - cosW0) / a0;
+				c[2] = c[0];
+			} break;
+			case BIQUAD_HIGHPASS: {
+				c[0] = (1.f + cosW0) * 0.5f / a0;
+				c[1] = -(1.f + cosW0) / a0;
+				c[2] = c[0];
+			} break;
+			case BIQUAD_ALLPASS: {
+				c[0] = (1.f - alpha) / a0;
+				c[1] = -2.f * cosW0 / a0;
+				c[2] = 1.f;
+			} break;
+			default: break;
+		}
+		if (type != BIQUAD_THROUGH) {
+			c[3] = -2.f * cosW0 / a0;
+			c[4] = (1.f - alpha) / a0;
+		}
+		b0[lane] = c[0];
+		b1[lane] = c[1];
+		b2[lane] = c[2];
+		a1[lane] = c[3];
+		a2[lane] = c[4];
+	}
+
+	void reset() {
+		s1 = 0.f;
+		s2 = 0.f;
+	}
+
+	float_4 process(float_4 x) {
+		float_4 y = b0 * x + s1;
+		s1 = b1 * x - a1 * y + s2;
+		s2 = b2 * x - a2 * y;
+		return y;
+	}
+};
+
+// Three-band LR4 crossover run as one cascade with the bands in lanes {low, mid, high, -}.
+// Low is delayed through the high crossover's allpass, so equal band inputs sum flat.
+struct QuantumCrossover {
+	QuantumBiquad4 stages[2][4]; // [channel][stage]
+	float sampleRate = 0.f;
+
+	void setSampleRate(float newSampleRate) {
+		if (newSampleRate == sampleRate)
+			return;
+		sampleRate = newSampleRate;
+		static const int types[4][QUANTUM_BANDS] = {
+			{BIQUAD_LOWPASS, BIQUAD_HIGHPASS, BIQUAD_HIGHPASS},
+			{BIQUAD_LOWPASS, BIQUAD_HIGHPASS, BIQUAD_HIGHPASS},
+			{BIQUAD_ALLPASS, BIQUAD_LOWPASS, BIQUAD_HIGHPASS},
+			{BIQUAD_THROUGH, BIQUAD_LOWPASS, BIQUAD_HIGHPASS},
+		};
+		for (int c = 0; c < 2; c++) {
+			for (int stage = 0; stage < 4; stage++) {
+				for (int band = 0; band < QUANTUM_BANDS; band++) {
+					float frequency = (stage < 2) ? QUANTUM_CROSSOVER_LOW : QUANTUM_CROSSOVER_HIGH;
+					stages[c][stage].setLane(band, types[stage][band], frequency, sampleRate);
+				}
+			}
+		}
+	}
+
+	void reset() {
+		for (int c = 0; c < 2; c++) {
+			for (int stage = 0; stage < 4; stage++)
+				stages[c][stage].reset();
+		}
+	}
+
+	// Band signals of one channel in, the sum of their filtered bands out
+	float process(int channel, float_4 bands) {
+		for (int stage = 0; stage < 4; stage++)
+			bands = stages[channel][stage].process(bands);
+		return bands[0] + bands[1] + bands[2];
+	}
+};
+
+// Four independent state-variable filters, one per lane, in the trapezoidal (TPT) form,
+// which stays stable while cutoffs move every control block
+struct QuantumSvf4 {
+	// Damping of a Butterworth response
+	static constexpr float K = M_SQRT2;
+
+	float_4 a1 = 1.f;
+	float_4 a2 = 0.f;
+	float_4 a3 = 0.f;
+	float_4 ic1 = 0.f;
+	float_4 ic2 = 0.f;
+
+	// Cutoff as a fraction of the sample rate
+	void setLane(int lane, float cutoff) {
+		float g = std::tan(M_PI * clamp(cutoff, 1e-5f, 0.49f));
+		a1[lane] = 1.f / (1.f + g * (g + K));
+		a2[lane] = g * a1[lane];
+		a3[lane] = g * a2[lane];
+	}
+
+	void reset() {
+		ic1 = 0.f;
+		ic2 = 0.f;
+	}
+
+	// One step, v1 is the band-pass and v2 the low-pass output
+	void step(float_4 x, float_4* v1, float_4* v2) {
+		float_4 v3 = x - ic2;
+		*v1 = a1 * ic1 + a2 * v3;
+		*v2 = ic2 + a2 * ic1 + a3 * v3;
+		ic1 = 2.f * *v1 - ic1;
+		ic2 = 2.f * *v2 - ic2;
+	}
+
+	float_4 lowpass(float_4 x) {
+		float_4 v1, v2;
+		step(x, &v1, &v2);
+		return v2;
+	}
+
+	float_4 highpass(float_4 x) {
+		float_4 v1, v2;
+		step(x, &v1, &v2);
+		return x - float_4(K) * v1 - v2;
+	}
+};
+
+// Soft limiter for four lanes with first-order antiderivative antialiasing (ADAA).
+// The curve is the identity up to KNEE and bends smoothly towards CEILING above it:
+//   f(x) = sgn(x) * (KNEE + W * d / sqrt(W^2 + d^2)),  d = |x| - KNEE,  W = CEILING - KNEE
+// Only the bend, r(x) = f(x) - x, can alias, so only it goes through the divided difference
+// of its antiderivative R(x) = W * sqrt(W^2 + d^2) - W^2 - d^2 / 2. Signals below the knee
+// pass bit-exact.
+struct QuantumSaturator4 {
+	static constexpr float KNEE = 5.f;
+	static constexpr float CEILING = 10.f;
+	static constexpr float W = CEILING - KNEE;
+
+	// Previous input, its distance past the knee and sqrt(W^2 + d^2)
+	float_4 x1 = 0.f;
+	float_4 d1 = 0.f;
+	float_4 s1 = W;
+
+	void reset() {
+		x1 = 0.f;
+		d1 = 0.f;
+		s1 = W;
+	}
+
+	float_4 process(float_4 x) {
+		float_4 d = simd::fmax(simd::fabs(x) - KNEE, 0.f);
+		float_4 s = simd::sqrt(W * W + d * d);
+		// (R(x) - R(x1)) / (x - x1) = q * (W / (s + s1) - 1/2) with q = (d^2 - d1^2) / (x - x1).
+		// Past the knee on one side q reduces to sgn(x) * (d + d1), which stays exact as x1
+		// approaches x. Elsewhere the division is well conditioned, and q is 0 below the knee.
+		float_4 dx = x - x1;
+		float_4 beyond = (d > 0.f) & (d1 > 0.f) & (x * x1 > 0.f);
+		float_4 quotient = simd::ifelse(simd::fabs(dx) > 1e-6f, (d * d - d1 * d1) / dx, 0.f);
+		float_4 q = simd::ifelse(beyond, simd::sgn(x) * (d + d1), quotient);
+		float_4 y = x + q * (W / (s + s1) - 0.5f);
+		x1 = x;
+		d1 = d;
+		s1 = s;
+		return y;
+	}
+};
+
+// Playback speeds a tap can be assigned in varispeed mode
+static const float QUANTUM_TAP_SPEEDS[] = {-1.f, 0.5f, 1.f, 2.f};
+static constexpr int QUANTUM_TAP_SPEEDS_LEN = 4;
+
+// Control values, written by the owner at any time and picked up on the next control tick
+struct QuantumControls {
+	float delayTime = 0.25f; // 0-1, scaled to 0-2000 ms
+	float spread = 0.5f;
+	float probability = 0.5f;
+	float feedback = 0.3f;
+	float mix = 0.5f;
+	float chaos = 0.1f;
+	float width = 0.f; // 0 keeps every tap centred
+	int panMode = PAN_STATIC;
+	bool midSide = false;
+	// Holds the captured history: no writes, the taps loop it once per buffer length
+	bool freeze = false;
+	// Replaces the tap mix with grain clouds spawned from each main tap's delay region
+	bool granular = false;
+	float grainDensity = 0.5f; // 0-1, 1 to 200 grains per second per tap at equal weights
+	float grainSize = 0.5f; // 0-1, 10 to 200 ms
+	// Main taps play at chaos-assigned speeds: reverse, half, unity or double
+	bool varispeed = false;
+	// Low, mid and high bands of the tap mix each follow their own weights and collapses
+	bool multiband = false;
+	// Replaces the tap mix with STFT frames delayed per tap and weighted per bin
+	bool spectral = false;
+	// Band-limits each tap's feedback, 0 leaves it unfiltered. Spread staggers the cutoffs
+	// from the shortest tap to the longest, chaos lets them drift.
+	float feedbackTone = 0.f;
+	float toneSpread = 0.5f;
+	// Sweeps each tap's delay with its own phase of a shared LFO, 0 leaves the taps still
+	float modDepth = 0.f; // 0-1, up to QUANTUM_MOD_MAX_MS
+	float modRate = 0.3f; // 0-1, see quantumModRate()
+	int modShape = LFO_SINE;
+	// Collapses snap the weights, with the tap gains ramped over one control block to declick,
+	// instead of gliding there through the weight smoother
+	bool hardCollapse = false;
+	int numBanks = 0;
+	float sampleRate = 48000.f;
+};
+
+struct QuantumFrame {
+	float inL = 0.f;
+	float inR = 0.f;
+	float outL = 0.f;
+	float outR = 0.f;
+	// Wet sum returned by expander banks, added before the output clamp
+	float bankL = 0.f;
+	float bankR = 0.f;
+	// Per-tap output voltages (16 channels max), or null
+	float* taps = nullptr;
+	bool stereoTaps = false;
+};
+
+inline float quantumGrainRate(float density) {
+	return std::pow(200.f, density);
+}
+
+inline float quantumGrainMs(float size) {
+	return 10.f * std::pow(20.f, size);
+}
+
+// Fills up to `count` stereo frames [frame][L/R] of a history preload at the engine's own
+// rate, oldest first, and returns how many it wrote, 0 once it has run dry
+typedef std::function<int(float* frames, int count)> QuantumHistorySource;
+
+// A replacement history, built off the audio thread by QuantumEngineBase::buildHistory().
+// After a swap it holds whatever it replaced, to be freed off the audio thread in turn.
+struct QuantumHistory {
+	void* buffers = nullptr; // laid out like the engine's delayBuffers, from the shared pool
+	size_t bytes = 0;
+	int writeIndex = 0;
+	QuantumTape* tape = nullptr; // tape mode only
+	int tapeIndex = 0;
+	// Set by a swap that handed it back unused, as it was built for an engine of another shape
+	bool rejected = false;
+
+	~QuantumHistory() {
+		quantumBufferPool().release(buffers, bytes);
+		delete tape;
+	}
+};
+
+struct QuantumEngineBase {
+	QuantumControls controls;
+	// Tap pairs reset after a NaN, Inf or runaway sample was caught in their history
+	uint32_t faultRecoveries = 0;
+#ifdef QSD_PROFILE
+	QuantumProfiler* profiler = nullptr;
+#endif
+
+	virtual ~QuantumEngineBase() {}
+	virtual int getTapCount() = 0;
+	virtual int getInterpolation() = 0;
+	virtual int getSampleFormat() = 0;
+	// Main taps followed by QUANTUM_MAX_BANKS * QUANTUM_BANK_TAPS bank taps
+	virtual float* getProbWeights() = 0;
+	virtual float* getTargetWeights() = 0;
+	virtual void seed(uint32_t seed) = 0;
+	// Clears history and quantum state without allocating
+	virtual void reset() = 0;
+	// Takes effect on the next frame processed, which runs its own control update
+	virtual void collapse() = 0;
+	// Frames the wet path trails the tap delays by, 0 outside spectral mode
+	virtual int getLatency() = 0;
+	// Frames a change of the tap mix, such as a collapse, takes to reach the output. Only
+	// the filters after the mix count, where getLatency() also counts those before the taps.
+	virtual int getMixLatency() = 0;
+	virtual void processFrame(QuantumFrame& frame) = 0;
+	// Stereo in/out; inR may be null for a mono source, outR may be null
+	virtual void processBlock(const float* inL, const float* inR, float* outL, float* outR, int frames) = 0;
+	virtual void fillBankMessage(QuantumBankMessage* message) = 0;
+	// Tape mode history, owned by the engine from then on. Before the first frame only.
+	virtual void setTape(QuantumTape* tape) = 0;
+	virtual QuantumTape* getTape() = 0;
+	// Frames of history the main taps reach back, at the engine's own rate
+	virtual int getHistoryFrames() = 0;
+	// Any thread: a fresh history holding getHistoryFrames() frames from `source`, or null
+	virtual QuantumHistory* buildHistory(const QuantumHistorySource& source) = 0;
+	// Audio thread: installs a history from buildHistory(), which may be null, and returns
+	// one to free off the audio thread, also null. A history built for an engine of another
+	// shape is handed straight back.
+	virtual QuantumHistory* swapHistory(QuantumHistory* history) = 0;
+	// Any thread but the audio one: allocates the spectral delay, which the engine takes up
+	// at its next control tick. Spectral mode stays off until then. Returns at once if done.
+	virtual void prepareSpectral() = 0;
+};
+
+template <int TAPS, typename TInterpolator, typename TSample>
+struct QuantumEngine : QuantumEngineBase {
+	static_assert(TAPS % 2 == 0, "taps are processed in pairs");
+
+	static constexpr int NUM_GROUPS = TAPS / 2; // one float_4 per tap pair
+	static constexpr int BANK_TAPS = QUANTUM_MAX_BANKS * QUANTUM_BANK_TAPS;
+	static constexpr int MAX_TAPS = TAPS + BANK_TAPS;
+	static constexpr int MAX_GROUPS = MAX_TAPS / 2;
+	static constexpr int CONTROL_INTERVAL = 64;
+	static constexpr int BUFFER_SIZE = 16000; // frames per tap, 1/3 s at 48kHz
+	static constexpr float INPUT_LIMIT = 100.f;
+
+	// Delay buffers [tap][frame][L/R], interleaved so both channels of a frame share a cache line.
+	// Carved from the shared pool so the buffers of many instances sit on few huge pages.
+	TSample* delayBuffers = nullptr;
+	int bufferSize = BUFFER_SIZE;
+	int writeIndex = 0;
+	int controlPhase = 0;
+	// Set by collapse(): the next frame runs the control update instead of waiting for the tick
+	bool collapsePending = false;
+	bool hardCollapsePending = false;
+	int declickFrames = 0; // left of a hard collapse's gain ramp
+	// Multiple of the host rate the engine runs at, see QuantumOversampledEngine
+	int oversampling = 1;
+	int controlInterval = CONTROL_INTERVAL;
+
+	// Quantum state variables, taps beyond TAPS belong to expander banks
+	float probWeights[MAX_TAPS];
+	float targetWeights[MAX_TAPS];
+	float weightVelocity[MAX_TAPS];
+	float delayTimes[MAX_TAPS]; // in samples
+	float feedbackLevels[TAPS];
+	float_4 entanglement[NUM_GROUPS]; // per tap pair, lanes {A L, A R, B L, B R}
+	float_4 faultMasks[NUM_GROUPS]; // lanes set when a tap read failed the health check this block
+	float peakCenter = TAPS / 2.f;
+	int numBanks = 0;
+	int numTaps = TAPS;
+
+	// Grain pool as structure of arrays, four grains per vector. The first activeGrains slots
+	// are live; the rest of the last vector has zero gain, so whole vectors can be rendered.
+	float_4 grainPositions[QUANTUM_GRAIN_CAPACITY / 4]; // fractional frame in the source buffer
+	float_4 grainIncrements[QUANTUM_GRAIN_CAPACITY / 4]; // playback speed
+	float_4 grainPhases[QUANTUM_GRAIN_CAPACITY / 4]; // window position, 0 to 1
+	float_4 grainPhaseIncrements[QUANTUM_GRAIN_CAPACITY / 4];
+	float_4 grainGainsL[QUANTUM_GRAIN_CAPACITY / 4];
+	float_4 grainGainsR[QUANTUM_GRAIN_CAPACITY / 4];
+	int32_t grainBuffers[QUANTUM_GRAIN_CAPACITY];
+	int activeGrains = 0;
+	float grainSpawnPhases[TAPS];
+	float grainSpawnRates[TAPS]; // grains per frame
+	float grainLength = 0.f; // frames
+	float grainGain = 1.f;
+
+	// Varispeed playback. Each main tap has two read heads that advance by their own speed
+	// and crossfade with Hann windows offset by half a segment, so the windows always sum
+	// to one. A head re-anchors to the tap's delay, and takes up a new speed, only where its
+	// window is closed.
+	bool varispeed = false;
+	float tapSpeeds[TAPS];
+	float headPositions[2][TAPS]; // fractional frame in the tap's buffer
+	float headSpeeds[2][TAPS];
+	float segmentPhases[TAPS]; // head 0, head 1 runs half a segment later
+	float segmentIncrement = 1.f / 4800.f;
+
+	// Delay modulation, four taps per vector. Phases start spread evenly across the taps,
+	// chaos detunes the rates. Varispeed heads carry their own motion and are not modulated.
+	static constexpr int MOD_VECTORS = (TAPS + 3) / 4;
+	bool modulated = false;
+	int modShape = LFO_SINE;
+	// Fetched by the constructor, so the audio thread never builds the shared table
+	const QuantumLfoTable* lfoTable = nullptr;
+	float modDepth = 0.f; // frames, peak to peak
+	float_4 modPhases[MOD_VECTORS];
+	float_4 modIncrements[MOD_VECTORS];
+	float modulatedDelays[MOD_VECTORS * 4];
+
+	// Multiband. The low band uses the main weights; mid and high keep their own over the
+	// main taps. One history serves every band: the delay line is linear, so filtering each
+	// band's weighted tap sum equals delaying band-split input, without three histories.
+	bool multiband = false;
+	float bandProbWeights[QUANTUM_BANDS - 1][TAPS];
+	float bandTargetWeights[QUANTUM_BANDS - 1][TAPS];
+	float bandWeightVelocity[QUANTUM_BANDS - 1][TAPS];
+	float bandPeakCenters[QUANTUM_BANDS - 1];
+	float_4 bandMixGains[QUANTUM_BANDS - 1][NUM_GROUPS];
+	QuantumCrossover crossover;
+
+	// Some 600 KB of frames, so only engines that go spectral get one
+	bool spectral = false;
+	std::atomic<QuantumSpectral<TAPS>*> preparedSpectral{nullptr};
+	QuantumSpectral<TAPS>* spectralDelay = nullptr;
+	uint32_t spectralSeed = 1;
+
+	// Tape mode. The main taps read and write one shared history of minutes instead of their
+	// own buffers, and the delay range spans the whole tape. Every tap's feedback goes back
+	// onto the same tape, which takes the place of entanglement. The taps' own buffers still
+	// record the input for grains; varispeed is off and expander banks are muted.
+	QuantumTape* tape = nullptr;
+	int tapeIndex = 0;
+
+	// Feedback filters, a high-pass into a low-pass per lane of each tap pair
+	bool feedbackFiltered = false;
+	QuantumSvf4 feedbackHighpass[NUM_GROUPS];
+	QuantumSvf4 feedbackLowpass[NUM_GROUPS];
+	float toneDrift[TAPS]; // octaves
+	// Bounds what each tap pair writes back, so no feedback setting can grow the history
+	QuantumSaturator4 feedbackSaturators[NUM_GROUPS];
+
+	// Stereo image
+	float panBase[MAX_TAPS];
+	float panDrift[MAX_TAPS];
+	float panPositions[MAX_TAPS]; // -1 (left) to 1 (right)
+	float_4 mixGains[MAX_GROUPS]; // weight * pan gain per lane
+	float_4 feedbackGains[NUM_GROUPS];
+	// Per-frame gain steps of a hard collapse's declick ramp
+	float_4 mixGainSteps[MAX_GROUPS];
+	float_4 bandMixGainSteps[QUANTUM_BANDS - 1][NUM_GROUPS];
+
+	// Random number generator
+	std::mt19937 rng;
+	std::uniform_real_distribution<float> uniformDist;
+
+	// An oversampled engine keeps the history length and control rate of a plain one
+	explicit QuantumEngine(int oversampling = 1) : oversampling(oversampling) {
+		bufferSize = BUFFER_SIZE * oversampling;
+		controlInterval = CONTROL_INTERVAL * oversampling;
+		delayBuffers = (TSample*) quantumBufferPool().allocate(bufferBytes());
+		lfoTable = &quantumLfoTable();
+		uniformDist = std::uniform_real_distribution<float>(0.f, 1.f);
+		seed(std::random_device{}());
+		reset();
+	}
+
+	~QuantumEngine() {
+		quantumBufferPool().release(delayBuffers, bufferBytes());
+		delete tape;
+		delete preparedSpectral.load();
+	}
+
+	size_t bufferBytes() const {
+		return sizeof(TSample) * TAPS * bufferSize * 2;
+	}
+
+	int getTapCount() override {
+		return TAPS;
+	}
+
+	int getInterpolation() override {
+		return std::is_same<TInterpolator, CubicInterpolator>::value ? INTERP_CUBIC : INTERP_LINEAR;
+	}
+
+	int getSampleFormat() override {
+		return QuantumSampleTraits<TSample>::FORMAT;
+	}
+
+	float* getProbWeights() override {
+		return probWeights;
+	}
+
+	float* getTargetWeights() override {
+		return targetWeights;
+	}
+
+	void seed(uint32_t seed) override {
+		rng.seed(seed);
+		uniformDist.reset();
+		spectralSeed = seed;
+		if (spectralDelay)
+			spectralDelay->seed(seed);
+	}
+
+	void reset() override {
+		std::fill(delayBuffers, delayBuffers + (size_t)TAPS * bufferSize * 2, TSample(0.f));
+		writeIndex = 0;
+		tapeIndex = 0;
+		controlPhase = 0;
+		collapsePending = false;
+		hardCollapsePending = false;
+		declickFrames = 0;
+		peakCenter = TAPS / 2.f;
+		if (spectralDelay)
+			spectralDelay->reset();
+		initializeQuantumState();
+	}
+
+	TSample* getBuffer(int b) {
+		return &delayBuffers[(size_t)b * bufferSize * 2];
+	}
+
+	// A tape whose memory could not be had is dropped, leaving the engine as it was
+	void setTape(QuantumTape* newTape) override {
+		delete tape;
+		tape = (newTape && newTape->frames) ? newTape : nullptr;
+		if (!tape)
+			delete newTape;
+		tapeIndex = 0;
+	}
+
+	QuantumTape* getTape() override {
+		return tape;
+	}
+
+	// Frames the main taps can reach back
+	int historySize() const {
+		return tape ? tape->size : bufferSize;
+	}
+
+	int getHistoryFrames() override {
+		return historySize();
+	}
+
+	// Only reads the engine's shape, which a swap never changes, so the UI thread may build
+	// while the audio thread runs. The newest bufferSize frames go into every tap's buffer.
+	QuantumHistory* buildHistory(const QuantumHistorySource& source) override {
+		std::unique_ptr<QuantumHistory> history(new QuantumHistory);
+		history->bytes = bufferBytes();
+		history->buffers = quantumBufferPool().allocate(history->bytes);
+		TSample* buffers = (TSample*) history->buffers;
+		std::fill(buffers, buffers + (size_t)TAPS * bufferSize * 2, TSample(0.f));
+		if (tape) {
+			history->tape = new QuantumTape(tape->path, tape->size, tape->prefetching);
+			if (!history->tape->frames)
+				return nullptr;
+		}
+
+		int total = historySize();
+		int firstBuffered = total - bufferSize;
+		const int CHUNK = 1024;
+		float chunk[CHUNK * 2];
+		int frame = 0;
+		while (frame < total) {
+			int count = source(chunk, std::min(CHUNK, total - frame));
+			if (count <= 0)
+				break;
+			for (int k = 0; k < count; k++, frame++) {
+				if (history->tape) {
+					history->tape->frames[(size_t)frame * 2] = chunk[k * 2];
+					history->tape->frames[(size_t)frame * 2 + 1] = chunk[k * 2 + 1];
+				}
+				if (frame < firstBuffered)
+					continue;
+				int i = frame % bufferSize;
+				for (int b = 0; b < TAPS; b++) {
+					buffers[((size_t)b * bufferSize + i) * 2] = TSample(chunk[k * 2]);
+					buffers[((size_t)b * bufferSize + i) * 2 + 1] = TSample(chunk[k * 2 + 1]);
+				}
+			}
+		}
+		history->writeIndex = frame % bufferSize;
+		history->tapeIndex = history->tape ? frame % history->tape->size : 0;
+		return history.release();
+	}
+
+	QuantumHistory* swapHistory(QuantumHistory* history) override {
+		if (!history)
+			return nullptr;
+		bool sameTape = tape ? (history->tape && history->tape->size == tape->size) : !history->tape;
+		if (history->bytes != bufferBytes() || !sameTape) {
+			history->rejected = true;
+			return history;
+		}
+
+		TSample* buffers = (TSample*) history->buffers;
+		history->buffers = delayBuffers;
+		delayBuffers = buffers;
+		writeIndex = history->writeIndex;
+		if (tape) {
+			std::swap(tape, history->tape);
+			tapeIndex = history->tapeIndex;
+			publishTapeHeads();
+		}
+		// What was caught in the old history no longer applies. Grains play on from the new
+		// one; varispeed heads start over from their taps, as the write head has moved.
+		for (int g = 0; g < NUM_GROUPS; g++)
+			faultMasks[g] = 0.f;
+		if (varispeed) {
+			for (int i = 0; i < TAPS; i++) {
+				anchorHead(0, i);
+				anchorHead(1, i);
+			}
+		}
+		return history;
+	}
+
+	// Any racing caller's copy is dropped, the first one published stays
+	void prepareSpectral() override {
+		if (preparedSpectral.load())
+			return;
+		QuantumSpectral<TAPS>* fresh = new QuantumSpectral<TAPS>();
+		QuantumSpectral<TAPS>* expected = nullptr;
+		if (!preparedSpectral.compare_exchange_strong(expected, fresh))
+			delete fresh;
+	}
+
+	void initializeQuantumState() {
+		float equalWeight = 1.f / TAPS;
+
+		for (int i = 0; i < MAX_TAPS; i++) {
+			int bank = (i < TAPS) ? 0 : 1 + (i - TAPS) / QUANTUM_BANK_TAPS;
+			int tap = (i < TAPS) ? i : (i - TAPS) % QUANTUM_BANK_TAPS;
+			int groups = (i < TAPS) ? NUM_GROUPS : QUANTUM_BANK_TAPS / 2;
+
+			// Expander taps fade in from silence when a bank is attached
+			probWeights[i] = (bank == 0) ? equalWeight : 0.f;
+			targetWeights[i] = probWeights[i];
+			weightVelocity[i] = 0.f;
+			delayTimes[i] = 1000.f + (tap * 1500.f); // Initial spread in samples
+
+			// Taps alternate sides, fanning outwards with delay time, mirrored on odd banks
+			panBase[i] = ((tap % 2 == bank % 2) ? -1.f : 1.f) * (tap / 2 + 1) / (float)groups;
+			panDrift[i] = 0.f;
+			panPositions[i] = 0.f;
+		}
+
+		for (int i = 0; i < TAPS; i++) {
+			feedbackLevels[i] = 0.3f;
+		}
+
+		for (int g = 0; g < MAX_GROUPS; g++) {
+			mixGains[g] = 0.f;
+		}
+
+		for (int g = 0; g < NUM_GROUPS; g++) {
+			entanglement[g] = 0.f;
+			feedbackGains[g] = 0.f;
+			faultMasks[g] = 0.f;
+		}
+
+		for (int v = 0; v < QUANTUM_GRAIN_CAPACITY / 4; v++) {
+			grainPositions[v] = 0.f;
+			grainIncrements[v] = 0.f;
+			grainPhases[v] = 0.f;
+			grainPhaseIncrements[v] = 0.f;
+			grainGainsL[v] = 0.f;
+			grainGainsR[v] = 0.f;
+		}
+		for (int k = 0; k < QUANTUM_GRAIN_CAPACITY; k++) {
+			grainBuffers[k] = 0;
+		}
+		for (int i = 0; i < TAPS; i++) {
+			grainSpawnPhases[i] = 0.f;
+			grainSpawnRates[i] = 0.f;
+		}
+		activeGrains = 0;
+
+		multiband = false;
+		crossover.reset();
+		for (int b = 0; b < QUANTUM_BANDS - 1; b++) {
+			for (int i = 0; i < TAPS; i++) {
+				bandProbWeights[b][i] = equalWeight;
+				bandTargetWeights[b][i] = equalWeight;
+				bandWeightVelocity[b][i] = 0.f;
+			}
+			bandPeakCenters[b] = TAPS / 2.f;
+			for (int g = 0; g < NUM_GROUPS; g++)
+				bandMixGains[b][g] = 0.f;
+		}
+
+		spectral = false;
+
+		feedbackFiltered = false;
+		for (int g = 0; g < NUM_GROUPS; g++) {
+			feedbackHighpass[g].reset();
+			feedbackLowpass[g].reset();
+			feedbackSaturators[g].reset();
+		}
+		for (int i = 0; i < TAPS; i++) {
+			toneDrift[i] = 0.f;
+		}
+
+		modulated = false;
+		for (int v = 0; v < MOD_VECTORS; v++) {
+			for (int l = 0; l < 4; l++)
+				modPhases[v][l] = (v * 4 + l) / (float)TAPS;
+			modIncrements[v] = 0.f;
+		}
+
+		varispeed = false;
+		for (int i = 0; i < TAPS; i++) {
+			tapSpeeds[i] = 1.f;
+			// Staggered so the taps do not all re-anchor on the same frame
+			segmentPhases[i] = i / (float)TAPS;
+			for (int h = 0; h < 2; h++) {
+				headPositions[h][i] = 0.f;
+				headSpeeds[h][i] = 1.f;
+			}
+		}
+	}
+
+	// Once per control block: clear the history of any tap pair whose reads went bad.
+	// Bad lanes are muted from the moment they are caught, so nothing leaks into the other pairs.
+	void recoverFaults() {
+		for (int g = 0; g < NUM_GROUPS; g++) {
+			if (!simd::movemask(faultMasks[g]))
+				continue;
+			for (int b = g * 2; b < g * 2 + 2; b++) {
+				TSample* buffer = getBuffer(b);
+				std::fill(buffer, buffer + bufferSize * 2, TSample(0.f));
+			}
+			entanglement[g] = 0.f;
+			faultMasks[g] = 0.f;
+			feedbackHighpass[g].reset();
+			feedbackLowpass[g].reset();
+			feedbackSaturators[g].reset();
+			faultRecoveries++;
+		}
+	}
+
+	// Position of a tap along the delay range, 0 to 1. Bank taps interleave between the main taps.
+	float tapPosition(int i) {
+		if (i < TAPS)
+			return i / (float)(TAPS - 1);
+		int bank = 1 + (i - TAPS) / QUANTUM_BANK_TAPS;
+		int tap = (i - TAPS) % QUANTUM_BANK_TAPS;
+		return (tap + bank / (float)(numBanks + 1)) / (float)(QUANTUM_BANK_TAPS - 1);
+	}
+
+	float fastRandom() {
+		return uniformDist(rng);
+	}
+
+	void updateProbabilityWeights() {
+		QUANTUM_PROFILE_SCOPE(profiler, PROFILE_WEIGHTS);
+		// Normalised across the main taps and every attached expander bank
+		evolveWeights(probWeights, targetWeights, weightVelocity, peakCenter, numTaps);
+
+		// Detached banks drop out immediately
+		for (int i = numTaps; i < MAX_TAPS; i++) {
+			probWeights[i] = 0.f;
+			targetWeights[i] = 0.f;
+			weightVelocity[i] = 0.f;
+		}
+
+		// The upper bands wander independently over the main taps
+		if (multiband) {
+			for (int b = 0; b < QUANTUM_BANDS - 1; b++)
+				evolveWeights(bandProbWeights[b], bandTargetWeights[b], bandWeightVelocity[b], bandPeakCenters[b], TAPS);
+		}
+	}
+
+	// One control step of a weight vector: reshape towards the probability control, add chaos,
+	// then glide the weights towards their targets
+	void evolveWeights(float* prob, float* target, float* velocity, float& peak, int count) {
+		float weights[MAX_TAPS];
+		float probabilityShape = controls.probability;
+		float chaosAmount = controls.chaos;
+
+		if (probabilityShape < 0.5f) {
+			// More uniform distribution
+			float uniformity = (0.5f - probabilityShape) * 2.f;
+			for (int i = 0; i < count; i++) {
+				weights[i] = (1.f - uniformity) * target[i] + uniformity / count;
+			}
+		} else {
+			// More peaked distribution
+			float peakedness = (probabilityShape - 0.5f) * 2.f;
+
+			peak += (fastRandom() - 0.5f) * chaosAmount * 0.5f;
+			peak = clamp(peak, 0.f, (float)(TAPS - 1));
+
+			float totalWeight = 0.f;
+			for (int i = 0; i < count; i++) {
+				float distance = std::abs(tapPosition(i) * (TAPS - 1) - peak);
+				weights[i] = std::exp(-distance * peakedness * 2.f);
+				totalWeight += weights[i];
+			}
+
+			// Normalize
+			for (int i = 0; i < count; i++) {
+				weights[i] /= totalWeight;
+			}
+		}
+
+		// Add chaos
+		for (int i = 0; i < count; i++) {
+			float chaos = (fastRandom() - 0.5f) * chaosAmount * 0.1f;
+			weights[i] = clamp(weights[i] + chaos, 0.f, 1.f);
+		}
+
+		// Normalize after chaos
+		float sum = 0.f;
+		for (int i = 0; i < count; i++) {
+			sum += weights[i];
+		}
+		for (int i = 0; i < count; i++) {
+			target[i] = weights[i] / sum;
+		}
+
+		// Smooth interpolation
+		for (int i = 0; i < count; i++) {
+			float error = target[i] - prob[i];
+			velocity[i] = velocity[i] * 0.9f + error * 0.1f;
+			prob[i] += velocity[i] * 0.05f;
+		}
+	}
+
+	void updateDelayTimes() {
+		QUANTUM_PROFILE_SCOPE(profiler, PROFILE_DELAY_TIMES);
+		float sampleRate = controls.sampleRate;
+
+		// Convert base delay time from 0-1 to samples, or to a fraction of the tape
+		int history = historySize();
+		float minDelaySamples = 10.f * oversampling; // ~0.2ms minimum
+		float maxDelaySamples = (controls.delayTime * 2000.f / 1000.f) * sampleRate; // 0-2000ms
+		if (tape)
+			maxDelaySamples = controls.delayTime * history;
+		maxDelaySamples = clamp(maxDelaySamples, minDelaySamples, (float)(history - 1));
+
+		for (int i = 0; i < numTaps; i++) {
+			float t = tapPosition(i);
+			float delayRange = (maxDelaySamples - minDelaySamples) * controls.spread;
+			delayTimes[i] = minDelaySamples + t * delayRange;
+
+			// Add slight randomization
+			delayTimes[i] += (fastRandom() - 0.5f) * sampleRate * 0.005f * controls.chaos;
+			delayTimes[i] = clamp(delayTimes[i], TInterpolator::MIN_DELAY, (float)(history - 1));
+		}
+	}
+
+	void updateTapGains() {
+		QUANTUM_PROFILE_SCOPE(profiler, PROFILE_TAP_GAINS);
+		for (int i = 0; i < numTaps; i++) {
+			float pan = panBase[i];
+
+			if (controls.panMode == PAN_WEIGHTS) {
+				// Dominant taps are pulled into the centre, the superposition spreads wide
+				float focus = clamp(probWeights[i] * numTaps - 1.f, 0.f, 1.f);
+				pan *= 1.f - focus;
+			} else if (controls.panMode == PAN_CHAOS) {
+				panDrift[i] += (fastRandom() - 0.5f) * controls.chaos * 0.05f;
+				panDrift[i] = clamp(panDrift[i] * 0.999f, -1.f, 1.f);
+				pan += panDrift[i];
+			}
+
+			panPositions[i] = clamp(pan * controls.width, -1.f, 1.f);
+		}
+
+		for (int g = 0; g < numTaps / 2; g++) {
+			int a = g * 2;
+			int b = a + 1;
+			// Balance law keeps a centred tap at unity in both channels
+			mixGains[g] = float_4(
+				probWeights[a] * std::min(1.f, 1.f - panPositions[a]),
+				probWeights[a] * std::min(1.f, 1.f + panPositions[a]),
+				probWeights[b] * std::min(1.f, 1.f - panPositions[b]),
+				probWeights[b] * std::min(1.f, 1.f + panPositions[b]));
+		}
+
+		if (multiband) {
+			for (int band = 0; band < QUANTUM_BANDS - 1; band++) {
+				const float* weights = bandProbWeights[band];
+				for (int g = 0; g < NUM_GROUPS; g++) {
+					int a = g * 2;
+					int b = a + 1;
+					bandMixGains[band][g] = float_4(
+						weights[a] * std::min(1.f, 1.f - panPositions[a]),
+						weights[a] * std::min(1.f, 1.f + panPositions[a]),
+						weights[b] * std::min(1.f, 1.f - panPositions[b]),
+						weights[b] * std::min(1.f, 1.f + panPositions[b]));
+				}
+			}
+		}
+
+		// Grain density follows the probability weights.
+		// Longest grains keep a quarter of the buffer, so pitched grains never outrun it.
+		float sampleRate = controls.sampleRate;
+		float rate = quantumGrainRate(controls.grainDensity);
+		grainLength = clamp(quantumGrainMs(controls.grainSize) * 0.001f * sampleRate, 16.f, bufferSize * 0.25f);
+		for (int i = 0; i < TAPS; i++) {
+			grainSpawnRates[i] = probWeights[i] * numTaps * rate / sampleRate;
+		}
+		// Overlapping grains sum like noise, scale by the expected overlap and the Hann power
+		float overlap = TAPS * rate * grainLength / sampleRate;
+		grainGain = 1.f / std::sqrt(std::max(overlap * 0.375f, 1.f));
+		if (!controls.granular) {
+			while (activeGrains > 0)
+				retireGrain(activeGrains - 1);
+		}
+
+		float globalFeedback = controls.feedback;
+		for (int g = 0; g < NUM_GROUPS; g++) {
+			int a = g * 2;
+			int b = a + 1;
+			feedbackGains[g] = float_4(
+				globalFeedback * feedbackLevels[a],
+				globalFeedback * feedbackLevels[a],
+				globalFeedback * feedbackLevels[b],
+				globalFeedback * feedbackLevels[b]);
+		}
+	}
+
+	// Control rate: cutoffs close in from both ends as the tone control rises, later taps
+	// further than earlier ones with spread
+	void updateFeedbackFilters() {
+		if (controls.feedbackTone <= 0.f) {
+			feedbackFiltered = false;
+			return;
+		}
+		if (!feedbackFiltered) {
+			feedbackFiltered = true;
+			for (int g = 0; g < NUM_GROUPS; g++) {
+				feedbackHighpass[g].reset();
+				feedbackLowpass[g].reset();
+			}
+		}
+
+		float tone = controls.feedbackTone;
+		float sampleRate = controls.sampleRate;
+		for (int i = 0; i < TAPS; i++) {
+			toneDrift[i] += (fastRandom() - 0.5f) * controls.chaos * 0.1f;
+			toneDrift[i] = clamp(toneDrift[i] * 0.999f, -1.f, 1.f);
+			float octaves = controls.toneSpread * (tapPosition(i) - 0.5f) * 3.f + toneDrift[i];
+			float highpassHz = 20.f * std::exp2(tone * 4.f + octaves);
+			float lowpassHz = 20000.f * std::exp2(-tone * 5.f - octaves);
+			for (int c = 0; c < 2; c++) {
+				feedbackHighpass[i / 2].setLane((i % 2) * 2 + c, highpassHz / sampleRate);
+				feedbackLowpass[i / 2].setLane((i % 2) * 2 + c, lowpassHz / sampleRate);
+			}
+		}
+	}
+
+	// Control rate
+	void updateModulation() {
+		modulated = (controls.modDepth > 0.f) && !varispeed;
+		if (!modulated)
+			return;
+		modShape = clamp(controls.modShape, 0, LFO_SHAPES_LEN - 1);
+		modDepth = controls.modDepth * QUANTUM_MOD_MAX_MS * 0.001f * controls.sampleRate;
+		float increment = quantumModRate(controls.modRate) / controls.sampleRate;
+		for (int i = 0; i < TAPS; i++)
+			modIncrements[i / 4][i % 4] = increment * (1.f + controls.chaos * 0.2f * (tapPosition(i) - 0.5f));
+	}
+
+	// Per frame: advances every tap's LFO and offsets its delay by 0 to modDepth, so no tap
+	// reads ahead of where it would unmodulated
+	void modulateDelays() {
+		const float* table = lfoTable->values[modShape];
+		float maxDelay = historySize() - 1.f;
+		for (int v = 0; v < MOD_VECTORS; v++) {
+			float_4 phase = modPhases[v] + modIncrements[v];
+			phase -= simd::floor(phase);
+			modPhases[v] = phase;
+
+			float_4 position = phase * (float) QUANTUM_LFO_SIZE;
+			float_4 x0, x1;
+			for (int l = 0; l < 4; l++) {
+				int i = std::min((int) position[l], QUANTUM_LFO_SIZE - 1);
+				x0[l] = table[i];
+				x1[l] = table[i + 1];
+			}
+			float_4 lfo = x0 + (x1 - x0) * (position - simd::floor(position));
+			float_4 delays = float_4::load(&delayTimes[v * 4]) + (lfo + 1.f) * (0.5f * modDepth);
+			simd::fmin(delays, maxDelay).store(&modulatedDelays[v * 4]);
+		}
+	}
+
+	// Control rate: with chaos, taps occasionally jump to a new playback speed
+	void updateTapSpeeds() {
+		float segmentFrames = clamp(0.1f * controls.sampleRate, 64.f, bufferSize * 0.25f);
+		segmentIncrement = 1.f / segmentFrames;
+
+		if (!controls.varispeed || tape) {
+			varispeed = false;
+			return;
+		}
+		if (!varispeed) {
+			// Start every head at its tap's delay, so switching on is seamless
+			varispeed = true;
+			for (int i = 0; i < TAPS; i++) {
+				anchorHead(0, i);
+				anchorHead(1, i);
+			}
+		}
+		for (int i = 0; i < TAPS; i++) {
+			if (fastRandom() < controls.chaos * 0.002f)
+				assignTapSpeed(i);
+		}
+	}
+
+	void assignTapSpeed(int i) {
+		tapSpeeds[i] = QUANTUM_TAP_SPEEDS[std::min((int)(fastRandom() * QUANTUM_TAP_SPEEDS_LEN), QUANTUM_TAP_SPEEDS_LEN - 1)];
+	}
+
+	// Restarts head h of tap i at the tap's delay, far enough back that a full segment at
+	// the new speed stays between the write head and the oldest frame
+	void anchorHead(int h, int i) {
+		float speed = tapSpeeds[i];
+		float segmentFrames = 1.f / segmentIncrement;
+		float delay = delayTimes[i] + segmentFrames * std::max(speed - 1.f, 0.f);
+		delay = std::min(delay, bufferSize - 2.f - segmentFrames * std::max(1.f - speed, 0.f));
+		headPositions[h][i] = wrapPosition(writeIndex - delay, bufferSize);
+		headSpeeds[h][i] = speed;
+	}
+
+	// Advances both heads of tap i by one frame and returns their window gains
+	void advanceHeads(int i, float* gain0, float* gain1) {
+		float phase = segmentPhases[i] + segmentIncrement;
+		if (phase >= 1.f)
+			phase -= 1.f;
+		segmentPhases[i] = phase;
+
+		float phases[2] = {phase, (phase >= 0.5f) ? phase - 0.5f : phase + 0.5f};
+		float gains[2];
+		for (int h = 0; h < 2; h++) {
+			if (phases[h] < segmentIncrement) {
+				// Window just closed, jump while silent
+				anchorHead(h, i);
+			} else {
+				headPositions[h][i] = wrapPosition(headPositions[h][i] + headSpeeds[h][i], bufferSize);
+			}
+			float w = phases[h] * QUANTUM_GRAIN_WINDOW_SIZE;
+			int w0 = std::min((int)w, QUANTUM_GRAIN_WINDOW_SIZE - 1);
+			const float* window = QuantumGrainWindow::values;
+			gains[h] = window[w0] + (window[w0 + 1] - window[w0]) * (w - w0);
+		}
+		*gain0 = gains[0];
+		*gain1 = gains[1];
+	}
+
+	// Reads a tap pair through both heads of each tap, lanes {A L, A R, B L, B R}
+	float_4 readVarispeed(int g) {
+		int a = g * 2;
+		int b = a + 1;
+		float gainA0, gainA1, gainB0, gainB1;
+		advanceHeads(a, &gainA0, &gainA1);
+		advanceHeads(b, &gainB0, &gainB1);
+		float_4 x0 = TInterpolator::read(getBuffer(a), headPositions[0][a], getBuffer(b), headPositions[0][b], bufferSize);
+		float_4 x1 = TInterpolator::read(getBuffer(a), headPositions[1][a], getBuffer(b), headPositions[1][b], bufferSize);
+		return x0 * float_4(gainA0, gainA0, gainB0, gainB0) + x1 * float_4(gainA1, gainA1, gainB1, gainB1);
+	}
+
+	void collapse() override {
+		// A collapse also reshuffles the playback speeds
+		if (varispeed) {
+			for (int i = 0; i < TAPS; i++)
+				assignTapSpeed(i);
+		}
+
+		if (spectral)
+			spectralDelay->collapse();
+
+		// Each upper band collapses onto its own dominant tap
+		if (multiband) {
+			for (int band = 0; band < QUANTUM_BANDS - 1; band++) {
+				int dominant = fastRandom() * TAPS;
+				for (int i = 0; i < TAPS; i++)
+					bandTargetWeights[band][i] = (i == dominant) ? 0.7f : 0.3f / (TAPS - 1);
+			}
+		}
+
+		int dominantBuffer = fastRandom() * numTaps;
+		float collapseFactor = 0.7f;
+
+		for (int i = 0; i < numTaps; i++) {
+			if (i == dominantBuffer) {
+				targetWeights[i] = collapseFactor;
+			} else {
+				targetWeights[i] = (1.f - collapseFactor) / (numTaps - 1);
+			}
+		}
+
+		// Lands on the next frame rather than at the next control tick, up to a block later
+		collapsePending = true;
+		if (controls.hardCollapse) {
+			hardCollapsePending = true;
+			for (int i = 0; i < numTaps; i++) {
+				probWeights[i] = targetWeights[i];
+				weightVelocity[i] = 0.f;
+			}
+			if (multiband) {
+				for (int band = 0; band < QUANTUM_BANDS - 1; band++) {
+					for (int i = 0; i < TAPS; i++) {
+						bandProbWeights[band][i] = bandTargetWeights[band][i];
+						bandWeightVelocity[band][i] = 0.f;
+					}
+				}
+			}
+		}
+	}
+
+	// Hard collapse: the gains just computed are reached over one control block from the ones
+	// before, so the snapped weights do not click
+	void startDeclick(const float_4* previousGains, const float_4 (*previousBandGains)[NUM_GROUPS]) {
+		float frames = controlInterval;
+		for (int g = 0; g < numTaps / 2; g++) {
+			mixGainSteps[g] = (mixGains[g] - previousGains[g]) / frames;
+			mixGains[g] = previousGains[g];
+		}
+		if (multiband) {
+			for (int band = 0; band < QUANTUM_BANDS - 1; band++) {
+				for (int g = 0; g < NUM_GROUPS; g++) {
+					bandMixGainSteps[band][g] = (bandMixGains[band][g] - previousBandGains[band][g]) / frames;
+					bandMixGains[band][g] = previousBandGains[band][g];
+				}
+			}
+		}
+		declickFrames = controlInterval;
+	}
+
+	void advanceDeclick() {
+		for (int g = 0; g < numTaps / 2; g++)
+			mixGains[g] += mixGainSteps[g];
+		if (multiband) {
+			for (int band = 0; band < QUANTUM_BANDS - 1; band++) {
+				for (int g = 0; g < NUM_GROUPS; g++)
+					bandMixGains[band][g] += bandMixGainSteps[band][g];
+			}
+		}
+		declickFrames--;
+	}
+
+	// Starts a grain in tap i's delay region. Position and pitch jitter follow the chaos amount.
+	void spawnGrain(int i) {
+		if (activeGrains >= QUANTUM_GRAIN_CAPACITY)
+			return;
+		float chaos = controls.chaos;
+		float speed = std::exp2((fastRandom() - 0.5f) * chaos); // up to half an octave either way
+		float delay = delayTimes[i] * (1.f + (fastRandom() - 0.5f) * chaos * 0.5f);
+
+		// Keep the whole grain between the write head and the oldest frame
+		float minDelay = 2.f + grainLength * std::max(speed - 1.f, 0.f);
+		float maxDelay = bufferSize - 3.f - grainLength * std::max(1.f - speed, 0.f);
+		delay = clamp(delay, minDelay, maxDelay);
+		float position = wrapPosition(writeIndex - delay, bufferSize);
+
+		int k = activeGrains++;
+		int v = k / 4;
+		int l = k % 4;
+		grainPositions[v][l] = position;
+		grainIncrements[v][l] = speed;
+		grainPhases[v][l] = 0.f;
+		grainPhaseIncrements[v][l] = 1.f / grainLength;
+		grainGainsL[v][l] = grainGain * std::min(1.f, 1.f - panPositions[i]);
+		grainGainsR[v][l] = grainGain * std::min(1.f, 1.f + panPositions[i]);
+		grainBuffers[k] = i;
+	}
+
+	// Moves the last live grain into slot k and silences the slot it leaves
+	void retireGrain(int k) {
+		int last = --activeGrains;
+		int v = k / 4, l = k % 4;
+		int lv = last / 4, ll = last % 4;
+		grainPositions[v][l] = grainPositions[lv][ll];
+		grainIncrements[v][l] = grainIncrements[lv][ll];
+		grainPhases[v][l] = grainPhases[lv][ll];
+		grainPhaseIncrements[v][l] = grainPhaseIncrements[lv][ll];
+		grainGainsL[v][l] = grainGainsL[lv][ll];
+		grainGainsR[v][l] = grainGainsR[lv][ll];
+		grainBuffers[k] = grainBuffers[last];
+		grainPhases[lv][ll] = 0.f;
+		grainPhaseIncrements[lv][ll] = 0.f;
+		grainGainsL[lv][ll] = 0.f;
+		grainGainsR[lv][ll] = 0.f;
+	}
+
+	// Sums every live grain into {L, R, 0, 0}. Loads are gathered per lane, window and
+	// sample interpolation, gains and advances run four grains at a time.
+	float_4 renderGrains() {
+		QUANTUM_PROFILE_SCOPE(profiler, PROFILE_GRAINS);
+		const float* window = QuantumGrainWindow::values;
+		float_4 size = (float) bufferSize;
+		float_4 sumL = 0.f;
+		float_4 sumR = 0.f;
+
+		int vectors = (activeGrains + 3) / 4;
+		for (int v = 0; v < vectors; v++) {
+			float_4 position = grainPositions[v];
+			float_4 windowPosition = grainPhases[v] * (float) QUANTUM_GRAIN_WINDOW_SIZE;
+			float_4 sampleFrac = position - simd::floor(position);
+			float_4 windowFrac = windowPosition - simd::floor(windowPosition);
+
+			int w[4];
+			const TSample* frame0[4];
+			const TSample* frame1[4];
+			for (int l = 0; l < 4; l++) {
+				w[l] = std::min((int) windowPosition[l], QUANTUM_GRAIN_WINDOW_SIZE - 1);
+				const TSample* buffer = getBuffer(grainBuffers[v * 4 + l]);
+				int i0 = (int) position[l];
+				frame0[l] = &buffer[i0 * 2];
+				frame1[l] = &buffer[wrapIndex(i0 + 1, bufferSize) * 2];
+			}
+			// Built in registers, lane stores into a vector would stall on store forwarding
+			float_4 w0(window[w[0]], window[w[1]], window[w[2]], window[w[3]]);
+			float_4 w1(window[w[0] + 1], window[w[1] + 1], window[w[2] + 1], window[w[3] + 1]);
+			float_4 l0(frame0[0][0], frame0[1][0], frame0[2][0], frame0[3][0]);
+			float_4 r0(frame0[0][1], frame0[1][1], frame0[2][1], frame0[3][1]);
+			float_4 l1(frame1[0][0], frame1[1][0], frame1[2][0], frame1[3][0]);
+			float_4 r1(frame1[0][1], frame1[1][1], frame1[2][1], frame1[3][1]);
+
+			float_4 envelope = w0 + (w1 - w0) * windowFrac;
+			sumL += (l0 + (l1 - l0) * sampleFrac) * envelope * grainGainsL[v];
+			sumR += (r0 + (r1 - r0) * sampleFrac) * envelope * grainGainsR[v];
+
+			position += grainIncrements[v];
+			grainPositions[v] = simd::ifelse(position >= size, position - size, position);
+			grainPhases[v] += grainPhaseIncrements[v];
+		}
+
+		// Retire finished grains, walking down so moved grains have already been checked
+		for (int v = vectors - 1; v >= 0; v--) {
+			int finished = simd::movemask(grainPhases[v] >= 1.f);
+			for (int l = 3; l >= 0; l--) {
+				if ((finished >> l) & 1)
+					retireGrain(v * 4 + l);
+			}
+		}
+
+		float wetL = sumL[0] + sumL[1] + sumL[2] + sumL[3];
+		float wetR = sumR[0] + sumR[1] + sumR[2] + sumR[3];
+		// History faults are caught by the tap reads, keep them out of the cloud meanwhile
+		wetL = (std::fabs(wetL) <= QUANTUM_FAULT_LIMIT) ? wetL : 0.f;
+		wetR = (std::fabs(wetR) <= QUANTUM_FAULT_LIMIT) ? wetR : 0.f;
+		return float_4(wetL, wetR, 0.f, 0.f);
+	}
+
+	void fillBankMessage(QuantumBankMessage* message) override {
+		message->delayBuffers = delayBuffers;
+		message->sampleFormat = QuantumSampleTraits<TSample>::FORMAT;
+		message->bufferCount = TAPS;
+		message->bufferSize = bufferSize;
+		message->writeIndex = wrapIndex(writeIndex - 1, bufferSize); // last frame written
+		message->hop = 1;
+		message->oversampling = oversampling;
+		message->returnDelay = 0;
+		message->frozen = controls.freeze;
+		for (int i = 0; i < BANK_TAPS; i++) {
+			message->weights[i] = probWeights[TAPS + i];
+			message->delayTimes[i] = delayTimes[TAPS + i];
+		}
+		for (int g = 0; g < BANK_TAPS / 2; g++) {
+			message->mixGains[g] = mixGains[NUM_GROUPS + g];
+		}
+		// Banks cannot reach the tape, and its delays would overrun the buffers they read
+		if (tape) {
+			for (int i = 0; i < BANK_TAPS; i++) {
+				message->weights[i] = 0.f;
+				message->delayTimes[i] = std::min(message->delayTimes[i], bufferSize - 1.f);
+			}
+			for (int g = 0; g < BANK_TAPS / 2; g++)
+				message->mixGains[g] = 0.f;
+		}
+	}
+
+	// Control rate: tells the prefetcher where the write head and each main tap are
+	void publishTapeHeads() {
+		tape->publish(QuantumTape::WRITE_HEAD, tapeIndex);
+		for (int i = 0; i < TAPS; i++)
+			tape->publish(1 + i, wrapIndex(tapeIndex - (int) delayTimes[i], tape->size));
+	}
+
+	// Reads a tap pair from the tape, lanes {A L, A R, B L, B R}. Minutes of frames leave a
+	// float position no fraction, so each tap's frames around its read position are gathered
+	// first and interpolated from there. A tap whose frames are not resident yet stays silent
+	// rather than fault them in.
+	float_4 readTape(int g, const float* delays) {
+		int size = tape->size;
+		float frames[2][8] = {}; // [tap][frame][L/R], from the frame before the read position
+		float fracs[2];
+		for (int t = 0; t < 2; t++) {
+			int i = g * 2 + t;
+			int whole = (int) std::ceil(delays[i]);
+			fracs[t] = whole - delays[i];
+			int first = wrapIndex(tapeIndex - whole - 1, size);
+			if (!tape->ready(1 + i, first, wrapIndex(first + 3, size)))
+				continue;
+			for (int k = 0; k < 4; k++) {
+				const float* frame = &tape->frames[wrapIndex(first + k, size) * 2];
+				frames[t][k * 2] = frame[0];
+				frames[t][k * 2 + 1] = frame[1];
+			}
+		}
+		return TInterpolator::read(frames[0], 1.f + fracs[0], frames[1], 1.f + fracs[1], 4);
+	}
+
+	// Input plus the mean of the taps' feedback, so the loop gain matches a tap's own
+	void writeTape(float sampleL, float sampleR, const float_4* feedbackSamples) {
+		float_4 feedbackSum = 0.f;
+		for (int g = 0; g < NUM_GROUPS; g++)
+			feedbackSum += feedbackSamples[g];
+		if (!tape->ready(QuantumTape::WRITE_HEAD, tapeIndex, tapeIndex))
+			return;
+		float* frame = &tape->frames[tapeIndex * 2];
+		frame[0] = sampleL + (feedbackSum[0] + feedbackSum[2]) / TAPS;
+		frame[1] = sampleR + (feedbackSum[1] + feedbackSum[3]) / TAPS;
+	}
+
+	void step(QuantumFrame& frame) {
+		// Update controls periodically, and on the frame a collapse lands
+		if (++controlPhase >= controlInterval || collapsePending) {
+			controlPhase = 0;
+			collapsePending = false;
+			// Any other update sets the gains outright, ending a ramp under way
+			bool declick = hardCollapsePending;
+			hardCollapsePending = false;
+			declickFrames = 0;
+			float_4 previousGains[MAX_GROUPS];
+			float_4 previousBandGains[QUANTUM_BANDS - 1][NUM_GROUPS];
+			if (declick) {
+				std::copy(mixGains, mixGains + MAX_GROUPS, previousGains);
+				for (int band = 0; band < QUANTUM_BANDS - 1; band++)
+					std::copy(bandMixGains[band], bandMixGains[band] + NUM_GROUPS, previousBandGains[band]);
+			}
+			recoverFaults();
+			numBanks = clamp(controls.numBanks, 0, QUANTUM_MAX_BANKS);
+			numTaps = TAPS + QUANTUM_BANK_TAPS * numBanks;
+			if (controls.multiband && !multiband)
+				crossover.reset();
+			multiband = controls.multiband;
+			crossover.setSampleRate(controls.sampleRate);
+			if (controls.spectral && !spectralDelay) {
+				// Seeded now, its draws start where they would have had it been there all along
+				spectralDelay = preparedSpectral.load();
+				if (spectralDelay)
+					spectralDelay->seed(spectralSeed);
+			}
+			if (controls.spectral && spectralDelay && !spectral)
+				spectralDelay->reset();
+			spectral = controls.spectral && spectralDelay;
+			updateProbabilityWeights();
+			updateDelayTimes();
+			updateTapGains();
+			updateTapSpeeds();
+			updateModulation();
+			updateFeedbackFilters();
+			if (tape)
+				publishTapeHeads();
+			if (spectral) {
+				float tapFeedback[TAPS];
+				for (int i = 0; i < TAPS; i++)
+					tapFeedback[i] = controls.feedback * feedbackLevels[i];
+				spectralDelay->setTaps(delayTimes, panPositions, probWeights, tapFeedback, controls.chaos);
+			}
+			if (declick)
+				startDeclick(previousGains, previousBandGains);
+		}
+		if (declickFrames > 0)
+			advanceDeclick();
+
+		bool frozen = controls.freeze;
+
+		// NaN inputs become silence, both selects compile without branches
+		float inputL = (frame.inL == frame.inL) ? clamp(frame.inL, -INPUT_LIMIT, INPUT_LIMIT) : 0.f;
+		float inputR = (frame.inR == frame.inR) ? clamp(frame.inR, -INPUT_LIMIT, INPUT_LIMIT) : 0.f;
+		float sampleL = inputL;
+		float sampleR = inputR;
+		if (controls.midSide) {
+			sampleL = (inputL + inputR) * 0.5f;
+			sampleR = (inputL - inputR) * 0.5f;
+		}
+
+		// Write to all delay buffers
+		if (!frozen) {
+			for (int b = 0; b < TAPS; b++) {
+				TSample* buffer = getBuffer(b);
+				buffer[writeIndex * 2] = sampleL;
+				buffer[writeIndex * 2 + 1] = sampleR;
+			}
+		}
+
+		const float* tapDelays = delayTimes;
+		if (modulated) {
+			modulateDelays();
+			tapDelays = modulatedDelays;
+		}
+
+		// Read from delay buffers with quantum superposition, one tap pair per vector
+		float_4 outputAccumulator = 0.f;
+		float_4 midAccumulator = 0.f;
+		float_4 highAccumulator = 0.f;
+		float_4 feedbackSamples[NUM_GROUPS];
+		float_4 entangleSamples[NUM_GROUPS];
+		float_4 entangleSum = 0.f;
+
+		{
+			QUANTUM_PROFILE_SCOPE(profiler, PROFILE_TAP_LOOP);
+			for (int g = 0; g < NUM_GROUPS; g++) {
+				int a = g * 2;
+				int b = a + 1;
+
+				float_4 delayedSample;
+				if (tape) {
+					delayedSample = readTape(g, tapDelays);
+				} else if (varispeed) {
+					delayedSample = readVarispeed(g);
+				} else {
+					float posA = wrapPosition(writeIndex - tapDelays[a], bufferSize);
+					float posB = wrapPosition(writeIndex - tapDelays[b], bufferSize);
+					delayedSample = TInterpolator::read(getBuffer(a), posA, getBuffer(b), posB, bufferSize);
+				}
+
+				// Health check, NaN fails the comparison too. Acted on at the next control tick.
+				faultMasks[g] = faultMasks[g] | ~(simd::fabs(delayedSample) <= QUANTUM_FAULT_LIMIT);
+				delayedSample = simd::ifelse(faultMasks[g], 0.f, delayedSample);
+
+				// Per-tap outputs straight from the tap vector
+				if (frame.taps) {
+					if (frame.stereoTaps) {
+						if (g * 4 + 4 <= 16)
+							delayedSample.store(&frame.taps[g * 4]);
+					} else {
+						frame.taps[a] = delayedSample[0];
+						frame.taps[b] = delayedSample[2];
+					}
+				}
+
+				// Apply probability weight and pan
+				outputAccumulator += delayedSample * mixGains[g];
+				if (multiband) {
+					midAccumulator += delayedSample * bandMixGains[0][g];
+					highAccumulator += delayedSample * bandMixGains[1][g];
+				}
+
+				// A frozen history is replayed untouched, which is unity feedback without the stores
+				if (frozen)
+					continue;
+
+				// Apply feedback with entanglement
+				feedbackSamples[g] = delayedSample * feedbackGains[g];
+				if (feedbackFiltered)
+					feedbackSamples[g] = feedbackLowpass[g].lowpass(feedbackHighpass[g].highpass(feedbackSamples[g]));
+				feedbackSamples[g] = feedbackSaturators[g].process(feedbackSamples[g]);
+				entangleSamples[g] = feedbackSamples[g] * entanglement[g] * 0.1f;
+				entangleSum += entangleSamples[g];
+
+				// Update entanglement based on buffer energy, normalized to ~0-1
+				entanglement[g] = entanglement[g] * 0.99f + simd::fabs(delayedSample) * (0.01f / 10.f);
+			}
+		}
+
+		if (tape && !frozen) {
+			writeTape(sampleL, sampleR, feedbackSamples);
+		} else if (!frozen) {
+			QUANTUM_PROFILE_SCOPE(profiler, PROFILE_ENTANGLEMENT);
+			// Entanglement: each buffer receives the feedback of all the others
+			float entangleL = entangleSum[0] + entangleSum[2];
+			float entangleR = entangleSum[1] + entangleSum[3];
+			float_4 entangleTotal(entangleL, entangleR, entangleL, entangleR);
+			int entangleIndex = wrapIndex(writeIndex + 10, bufferSize);
+
+			for (int g = 0; g < NUM_GROUPS; g++) {
+				TSample* bufferA = getBuffer(g * 2);
+				TSample* bufferB = getBuffer(g * 2 + 1);
+
+				// Self-feedback
+				storeTapPair(bufferA, writeIndex, bufferB, writeIndex,
+					loadTapPair(bufferA, writeIndex, bufferB, writeIndex) + feedbackSamples[g]);
+				storeTapPair(bufferA, entangleIndex, bufferB, entangleIndex,
+					loadTapPair(bufferA, entangleIndex, bufferB, entangleIndex) + entangleTotal - entangleSamples[g]);
+			}
+		}
+
+		if (multiband) {
+			// Band sums per channel in lanes {low, mid, high, -}, filtered in one cascade
+			float wetL = crossover.process(0, float_4(outputAccumulator[0] + outputAccumulator[2], midAccumulator[0] + midAccumulator[2], highAccumulator[0] + highAccumulator[2], 0.f));
+			float wetR = crossover.process(1, float_4(outputAccumulator[1] + outputAccumulator[3], midAccumulator[1] + midAccumulator[3], highAccumulator[1] + highAccumulator[3], 0.f));
+			outputAccumulator = float_4(wetL, wetR, 0.f, 0.f);
+		}
+
+		if (spectral) {
+			QUANTUM_PROFILE_SCOPE(profiler, PROFILE_SPECTRAL);
+			outputAccumulator = spectralDelay->process(sampleL, sampleR, frozen);
+			// The frames share one history, a bad bin starts them all over
+			if (simd::movemask(simd::fabs(outputAccumulator) <= QUANTUM_FAULT_LIMIT) != 0xf) {
+				spectralDelay->reset();
+				outputAccumulator = 0.f;
+				faultRecoveries++;
+			}
+		}
+
+		if (controls.granular) {
+			for (int i = 0; i < TAPS; i++) {
+				grainSpawnPhases[i] += grainSpawnRates[i];
+				if (grainSpawnPhases[i] >= 1.f) {
+					// Jittered intervals keep the cloud from locking to a pulse
+					grainSpawnPhases[i] -= 1.f + (fastRandom() - 0.5f) * controls.chaos;
+					spawnGrain(i);
+				}
+			}
+			outputAccumulator = renderGrains();
+		}
+
+		QUANTUM_PROFILE_SCOPE(profiler, PROFILE_OUTPUT);
+
+		// Sum tap lanes into L/R (or M/S)
+		float wetL = outputAccumulator[0] + outputAccumulator[2] + frame.bankL;
+		float wetR = outputAccumulator[1] + outputAccumulator[3] + frame.bankR;
+		if (controls.midSide) {
+			float mid = wetL;
+			wetL = mid + wetR;
+			wetR = mid - wetR;
+		}
+
+		// Mix dry and wet
+		float dryWetMix = controls.mix;
+		wetL = clamp(wetL, -10.f, 10.f);
+		wetR = clamp(wetR, -10.f, 10.f);
+		frame.outL = inputL * (1.f - dryWetMix) + wetL * dryWetMix;
+		frame.outR = inputR * (1.f - dryWetMix) + wetR * dryWetMix;
+
+		// Advance write pointer
+		writeIndex = wrapIndex(writeIndex + 1, bufferSize);
+		if (tape)
+			tapeIndex = wrapIndex(tapeIndex + 1, tape->size);
+	}
+
+	int getLatency() override {
+		return spectral ? QUANTUM_SPECTRAL_SIZE : 0;
+	}
+
+	int getMixLatency() override {
+		return getLatency();
+	}
+
+	void processFrame(QuantumFrame& frame) override {
+		step(frame);
+	}
+
+	void processBlock(const float* inL, const float* inR, float* outL, float* outR, int frames) override {
+		QuantumFrame frame;
+		for (int i = 0; i < frames; i++) {
+			frame.inL = inL[i];
+			frame.inR = inR ? inR[i] : inL[i];
+			step(frame);
+			outL[i] = frame.outL;
+			if (outR)
+				outR[i] = frame.outR;
+		}
+	}
+};
+
+extern template struct QuantumEngine<4, LinearInterpolator, float>;
+extern template struct QuantumEngine<4, LinearInterpolator, Half>;
+extern template struct QuantumEngine<4, CubicInterpolator, float>;
+extern template struct QuantumEngine<4, CubicInterpolator, Half>;
+extern template struct QuantumEngine<6, LinearInterpolator, float>;
+extern template struct QuantumEngine<6, LinearInterpolator, Half>;
+extern template struct QuantumEngine<6, CubicInterpolator, float>;
+extern template struct QuantumEngine<6, CubicInterpolator, Half>;
+extern template struct QuantumEngine<8, LinearInterpolator, float>;
+extern template struct QuantumEngine<8, LinearInterpolator, Half>;
+extern template struct QuantumEngine<8, CubicInterpolator, float>;
+extern template struct QuantumEngine<8, CubicInterpolator, Half>;
+extern template struct QuantumEngine<16, LinearInterpolator, float>;
+extern template struct QuantumEngine<16, LinearInterpolator, Half>;
+extern template struct QuantumEngine<16, CubicInterpolator, float>;
+extern template struct QuantumEngine<16, CubicInterpolator, Half>;
+
+// Allocates; call from the UI or loader thread, never from process().
+// An oversampling of 2 or 4 runs the engine at that multiple of the host rate.
+QuantumEngineBase* createQuantumEngine(int taps, int interpolation, int sampleFormat, int oversampling = 1);
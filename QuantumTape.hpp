@@ -0,0 +1,211 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Minutes of stereo history for tape mode, [frame][L/R] floats in a memory-mapped scratch
+// file, so a long tape costs page cache instead of resident memory.
+//
+// The audio thread must never wait for the disk. It publishes the frame each head is at;
+// a prefetch thread pulls the pages around and ahead of every head into memory, dirties
+// the ones the write head is coming up to, and marks them all in a residency bitmap. The
+// audio thread only touches marked pages: a tap whose frames are unmarked is muted and a
+// write to an unmarked page is dropped, and each page found that way counts as late. Marks
+// are cleared once no head is near a page, so the OS may evict it again.
+//
+// The file is unlinked as soon as it is mapped, so nothing is left behind after a crash.
+// Where it cannot be mapped, and on Windows, the tape falls back to the heap; `frames` is
+// null if that fails too. Built and destroyed on the UI thread.
+struct QuantumTape {
+	static constexpr int PAGE_FRAMES = 512; // 4 KB of stereo float frames
+	static constexpr int MAX_FRAMES = 1 << 28; // 2 GB
+	// Heads move a frame per frame, so this read-ahead lasts ~1.4 s at 48 kHz
+	static constexpr int AHEAD_PAGES = 128;
+	// Kept behind each published position for interpolation and delay modulation
+	static constexpr int BEHIND_PAGES = 8;
+	static constexpr int PREFETCH_MS = 2;
+	// The write head, then one per main tap
+	static constexpr int WRITE_HEAD = 0;
+	static constexpr int MAX_HEADS = 17;
+
+	float* frames = nullptr;
+	int size = 0; // frames, whole pages
+	int pages = 0;
+	bool mapped = false;
+	size_t bytes = 0;
+	// Kept so a fresh tape of the same shape can be opened, see QuantumEngine::buildHistory()
+	std::string path;
+	bool prefetching = false;
+
+	// Frame each head is at, -1 while unused. Published by the audio thread.
+	std::atomic<int> heads[MAX_HEADS];
+	// Pages found unmarked, each counted once per head that hit it
+	std::atomic<uint32_t> latePages{0};
+	int lastLatePages[MAX_HEADS]; // audio thread
+
+	// One bit per page, written by the prefetch thread only
+	std::unique_ptr<std::atomic<uint64_t>[]> resident;
+	std::vector<uint64_t> wanted; // prefetch thread scratch
+	int words = 0;
+
+	std::atomic<bool> running{false};
+	std::thread prefetcher;
+
+	// `length` in frames. Offline renders can afford to fault pages in: without `prefetch`
+	// every page counts as resident and no thread is started.
+	QuantumTape(const std::string& path, int length, bool prefetch = true) : path(path), prefetching(prefetch) {
+		pages = (clampFrames(length) + PAGE_FRAMES - 1) / PAGE_FRAMES;
+		size = pages * PAGE_FRAMES;
+		bytes = (size_t) size * 2 * sizeof(float);
+		words = (pages + 63) / 64;
+		resident.reset(new std::atomic<uint64_t>[words]);
+		wanted.assign(words, 0);
+		for (int h = 0; h < MAX_HEADS; h++) {
+			heads[h].store(-1, std::memory_order_relaxed);
+			lastLatePages[h] = -1;
+		}
+
+		mapped = map(path);
+		if (!mapped)
+			frames = (float*) std::calloc((size_t) size * 2, sizeof(float));
+		for (int w = 0; w < words; w++)
+			resident[w].store((mapped && prefetch) ? 0 : ~(uint64_t) 0, std::memory_order_relaxed);
+		if (mapped && prefetch) {
+			running.store(true);
+			prefetcher = std::thread(&QuantumTape::prefetchLoop, this);
+		}
+	}
+
+	~QuantumTape() {
+		if (running.exchange(false))
+			prefetcher.join();
+		unmap();
+	}
+
+	static int clampFrames(int length) {
+		return std::min(std::max(length, PAGE_FRAMES), MAX_FRAMES);
+	}
+
+	bool isResident(int page) const {
+		return (resident[page >> 6].load(std::memory_order_acquire) >> (page & 63)) & 1;
+	}
+
+	// Audio thread: whether head h may touch frames first to last, both already wrapped
+	bool ready(int h, int first, int last) {
+		int firstPage = first / PAGE_FRAMES;
+		int lastPage = last / PAGE_FRAMES;
+		bool firstReady = isResident(firstPage);
+		if (firstReady && isResident(lastPage))
+			return true;
+		int page = firstReady ? lastPage : firstPage;
+		if (page != lastLatePages[h]) {
+			lastLatePages[h] = page;
+			latePages.fetch_add(1, std::memory_order_relaxed);
+		}
+		return false;
+	}
+
+	void publish(int h, int frame) {
+		heads[h].store(frame, std::memory_order_relaxed);
+	}
+
+	void prefetchLoop() {
+		while (running.load(std::memory_order_relaxed)) {
+			prefetch();
+			std::this_thread::sleep_for(std::chrono::milliseconds(PREFETCH_MS));
+		}
+	}
+
+	// One pass: mark every page within reach of a head, touching the newly marked ones first
+	void prefetch() {
+		std::fill(wanted.begin(), wanted.end(), 0);
+		for (int h = 0; h < MAX_HEADS; h++) {
+			int frame = heads[h].load(std::memory_order_relaxed);
+			if (frame < 0 || frame >= size)
+				continue;
+			int page = frame / PAGE_FRAMES;
+			for (int p = -BEHIND_PAGES; p <= AHEAD_PAGES; p++) {
+				int q = ((page + p) % pages + pages) % pages;
+				// Only the pages the write head is coming up to need to be writable
+				if (h == WRITE_HEAD && p >= 0)
+					touch(q, true);
+				wanted[q >> 6] |= (uint64_t) 1 << (q & 63);
+			}
+		}
+		for (int w = 0; w < words; w++) {
+			uint64_t have = resident[w].load(std::memory_order_relaxed);
+			uint64_t fresh = wanted[w] & ~have;
+			for (int bit = 0; fresh; bit++, fresh >>= 1) {
+				if (fresh & 1)
+					touch(w * 64 + bit, false);
+			}
+			if (wanted[w] != have)
+				resident[w].store(wanted[w], std::memory_order_release);
+		}
+	}
+
+	// Faults a page in. Writable pages are dirtied with a compare-and-swap of a word with
+	// itself, which cannot lose a store the audio thread makes to it at the same time.
+	void touch(int page, bool writable) {
+		volatile float* first = &frames[(size_t) page * PAGE_FRAMES * 2];
+		if (!writable) {
+			(void) *first;
+			return;
+		}
+#ifdef _WIN32
+		(void) *first;
+#else
+		uint32_t* word = (uint32_t*) first;
+		uint32_t value = __atomic_load_n(word, __ATOMIC_RELAXED);
+		__atomic_compare_exchange_n(word, &value, value, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+#endif
+	}
+
+	bool map(const std::string& path) {
+#ifdef _WIN32
+		(void) path;
+		return false;
+#else
+		int fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+		if (fd < 0)
+			return false;
+		// Allocates the blocks now, so the audio thread's stores never wait on the file system
+#ifdef __linux__
+		bool sized = posix_fallocate(fd, 0, bytes) == 0;
+#else
+		bool sized = false;
+#endif
+		if (!sized)
+			sized = ftruncate(fd, bytes) == 0;
+		void* address = sized ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+		close(fd);
+		unlink(path.c_str());
+		if (address == MAP_FAILED)
+			return false;
+		frames = (float*) address;
+		return true;
+#endif
+	}
+
+	void unmap() {
+#ifndef _WIN32
+		if (mapped) {
+			munmap(frames, bytes);
+			return;
+		}
+#endif
+		std::free(frames);
+	}
+};
@@ -0,0 +1,416 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Streaming RIFF/WAVE I/O. Memory use is one block of raw bytes, independent of file length.
+// Reads 8/16/24/32-bit PCM and 32/64-bit float, writes 32-bit float.
+
+enum QuantumWavEncoding {
+	WAV_PCM = 1,
+	WAV_FLOAT = 3,
+	WAV_EXTENSIBLE = 0xfffe
+};
+
+struct WavReader {
+	FILE* file = nullptr;
+	int channels = 0;
+	int sampleRate = 0;
+	int bitsPerSample = 0;
+	int encoding = 0;
+	int64_t frames = 0;
+	int64_t framesLeft = 0;
+	std::vector<uint8_t> raw;
+
+	~WavReader() {
+		close();
+	}
+
+	static uint32_t readLE(const uint8_t* p, int bytes) {
+		uint32_t x = 0;
+		for (int i = 0; i < bytes; i++)
+			x |= (uint32_t)p[i] << (8 * i);
+		return x;
+	}
+
+	bool open(const std::string& path, std::string* error) {
+		close();
+		file = std::fopen(path.c_str(), "rb");
+		if (!file) {
+			*error = "cannot open " + path;
+			return false;
+		}
+
+		uint8_t header[12];
+		if (std::fread(header, 1, 12, file) != 12 || std::memcmp(header, "RIFF", 4) || std::memcmp(header + 8, "WAVE", 4)) {
+			*error = path + " is not a RIFF/WAVE file";
+			close();
+			return false;
+		}
+
+		// Walk the chunks until "data", picking up "fmt " on the way
+		bool haveFormat = false;
+		while (true) {
+			uint8_t chunk[8];
+			if (std::fread(chunk, 1, 8, file) != 8) {
+				*error = path + " has no data chunk";
+				close();
+				return false;
+			}
+			uint32_t size = readLE(chunk + 4, 4);
+
+			if (!std::memcmp(chunk, "fmt ", 4)) {
+				uint8_t fmt[40] = {};
+				uint32_t keep = std::min(size, (uint32_t)sizeof(fmt));
+				if (size < 16 || std::fread(fmt, 1, keep, file) != keep) {
+					*error = path + " has a malformed fmt chunk";
+					close();
+					return false;
+				}
+				std::fseek(file, (long)(size - keep + (size & 1)), SEEK_CUR);
+				encoding = readLE(fmt, 2);
+				channels = readLE(fmt + 2, 2);
+				sampleRate = readLE(fmt + 4, 4);
+				bitsPerSample = readLE(fmt + 14, 2);
+				// WAVE_FORMAT_EXTENSIBLE keeps the real encoding in the subformat GUID
+				if (encoding == WAV_EXTENSIBLE && size >= 26)
+					encoding = readLE(fmt + 24, 2);
+				haveFormat = true;
+			} else if (!std::memcmp(chunk, "data", 4)) {
+				if (!haveFormat) {
+					*error = path + " has data before fmt";
+					close();
+					return false;
+				}
+				int frameBytes = channels * (bitsPerSample / 8);
+				frames = (frameBytes > 0) ? size / frameBytes : 0;
+				framesLeft = frames;
+				break;
+			} else {
+				std::fseek(file, (long)(size + (size & 1)), SEEK_CUR);
+			}
+		}
+
+		bool pcm = (encoding == WAV_PCM) && (bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32);
+		bool fp = (encoding == WAV_FLOAT) && (bitsPerSample == 32 || bitsPerSample == 64);
+		if (!(pcm || fp) || channels < 1 || sampleRate < 1) {
+			*error = path + ": unsupported encoding " + std::to_string(encoding) + "/" + std::to_string(bitsPerSample) + " bit";
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	float decode(const uint8_t* p) const {
+		if (encoding == WAV_FLOAT) {
+			if (bitsPerSample == 64) {
+				double d;
+				std::memcpy(&d, p, 8);
+				return (float)d;
+			}
+			float f;
+			std::memcpy(&f, p, 4);
+			return f;
+		}
+		switch (bitsPerSample) {
+			case 8: return (p[0] - 128) / 128.f;
+			case 16: return (int16_t)readLE(p, 2) / 32768.f;
+			case 24: return (int32_t)(readLE(p, 3) << 8) / 2147483648.f;
+			default: return (int32_t)readLE(p, 4) / 2147483648.f;
+		}
+	}
+
+	// Reads up to `maxFrames` frames as -1..1 floats. Mono files are copied to both sides,
+	// channels beyond the first two are dropped. Returns the number of frames read.
+	int read(float* left, float* right, int maxFrames) {
+		if (!file || framesLeft <= 0)
+			return 0;
+		int count = (int)std::min<int64_t>(maxFrames, framesLeft);
+		int sampleBytes = bitsPerSample / 8;
+		int frameBytes = channels * sampleBytes;
+		raw.resize((size_t)count * frameBytes);
+		count = (int)(std::fread(raw.data(), 1, raw.size(), file) / frameBytes);
+		framesLeft = (count > 0) ? framesLeft - count : 0;
+
+		for (int i = 0; i < count; i++) {
+			const uint8_t* frame = &raw[(size_t)i * frameBytes];
+			left[i] = decode(frame);
+			right[i] = (channels > 1) ? decode(frame + sampleBytes) : left[i];
+		}
+		return count;
+	}
+
+	void close() {
+		if (file)
+			std::fclose(file);
+		file = nullptr;
+	}
+};
+
+// Random access to a WAV file's frames through a read-only memory mapping, so only the
+// frames actually decoded are paged in, however long the file. Windows reads the data
+// chunk into memory instead.
+struct WavMapping {
+	WavReader format; // header fields and decode(); its file is closed once mapped
+	const uint8_t* data = nullptr;
+	int64_t frames = 0;
+	int sampleBytes = 0;
+	int frameBytes = 0;
+	void* base = nullptr;
+	size_t mappedBytes = 0;
+	std::vector<uint8_t> copy;
+
+	~WavMapping() {
+		close();
+	}
+
+	bool open(const std::string& path, std::string* error) {
+		close();
+		if (!format.open(path, error))
+			return false;
+		long offset = std::ftell(format.file);
+		format.close();
+		sampleBytes = format.bitsPerSample / 8;
+		frameBytes = format.channels * sampleBytes;
+
+#ifdef _WIN32
+		FILE* file = std::fopen(path.c_str(), "rb");
+		if (file && std::fseek(file, offset, SEEK_SET) == 0) {
+			copy.resize((size_t) format.frames * frameBytes);
+			copy.resize(std::fread(copy.data(), 1, copy.size(), file) / frameBytes * frameBytes);
+		}
+		if (file)
+			std::fclose(file);
+		data = copy.data();
+		frames = copy.size() / frameBytes;
+#else
+		int fd = ::open(path.c_str(), O_RDONLY);
+		struct stat info;
+		if (fd >= 0 && fstat(fd, &info) == 0 && info.st_size > offset) {
+			mappedBytes = info.st_size;
+			base = mmap(nullptr, mappedBytes, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (base == MAP_FAILED)
+				base = nullptr;
+		}
+		if (fd >= 0)
+			::close(fd);
+		if (base) {
+			data = (const uint8_t*) base + offset;
+			// A header written before the file was finished may claim more than is there
+			frames = std::min<int64_t>(format.frames, (mappedBytes - offset) / frameBytes);
+		}
+#endif
+		if (!data || frames < 1) {
+			*error = path + " has no frames to read";
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	// -1..1, mono copied to both sides, silence outside the file
+	void read(int64_t frame, float* left, float* right) const {
+		if (frame < 0 || frame >= frames) {
+			*left = *right = 0.f;
+			return;
+		}
+		const uint8_t* p = data + frame * frameBytes;
+		*left = format.decode(p);
+		*right = (format.channels > 1) ? format.decode(p + sampleBytes) : *left;
+	}
+
+	void close() {
+#ifndef _WIN32
+		if (base)
+			munmap(base, mappedBytes);
+#endif
+		base = nullptr;
+		mappedBytes = 0;
+		copy.clear();
+		data = nullptr;
+		frames = 0;
+	}
+};
+
+// Streams the last `count` frames of a mapped file at another sample rate, oldest first,
+// led by silence where the file is shorter. The newest frame lands on the file's last one.
+// Cubic Hermite interpolation going up. Going down, a windowed-sinc lowpass below the new
+// rate's Nyquist frequency keeps what lies above it from folding back into the history.
+struct WavTailResampler {
+	// Zero crossings each side of the kernel, and table points per crossing
+	static constexpr int SINC_ZEROS = 8;
+	static constexpr int SINC_RESOLUTION = 256;
+	// Passband edge as a fraction of the new Nyquist frequency, leaving the kernel room to roll off
+	static constexpr double SINC_CUTOFF = 0.9;
+
+	const WavMapping& source;
+	double step;
+	double position;
+	int64_t remaining;
+	// Right half of the Blackman-windowed kernel, only when downsampling
+	std::vector<float> sinc;
+	double sincScale = 0.0; // table points per source frame
+	int sincReach = 0; // source frames each side
+
+	WavTailResampler(const WavMapping& source, double rate, int64_t count) : source(source), remaining(count) {
+		step = source.format.sampleRate / rate;
+		position = (source.frames - 1) - (count - 1) * step;
+		if (step > 1.0) {
+			sinc.resize(SINC_ZEROS * SINC_RESOLUTION + 1);
+			for (int i = 0; i < (int) sinc.size(); i++) {
+				double x = (double) i / SINC_RESOLUTION;
+				double window = 0.42 + 0.5 * std::cos(M_PI * x / SINC_ZEROS) + 0.08 * std::cos(2.0 * M_PI * x / SINC_ZEROS);
+				sinc[i] = (float) ((i == 0) ? 1.0 : std::sin(M_PI * x) / (M_PI * x) * window);
+			}
+			sincScale = SINC_CUTOFF / step * SINC_RESOLUTION;
+			sincReach = (int) std::ceil(SINC_ZEROS * step / SINC_CUTOFF);
+		}
+	}
+
+	// Up to `maxFrames` interleaved stereo frames; returns how many, 0 once done
+	int read(float* frames, int maxFrames) {
+		int count = (int) std::min<int64_t>(maxFrames, remaining);
+		for (int i = 0; i < count; i++, position += step) {
+			double whole = std::floor(position);
+			float t = (float) (position - whole);
+			int64_t j = (int64_t) whole;
+			if (!sinc.empty()) {
+				lowpass(j, t, &frames[2 * i], &frames[2 * i + 1]);
+				continue;
+			}
+			float l[4], r[4];
+			// Past the last frame holds it, so the newest frames do not ring against silence
+			for (int k = 0; k < 4; k++)
+				source.read(std::min(j - 1 + k, source.frames - 1), &l[k], &r[k]);
+			frames[2 * i] = hermite(l, t);
+			frames[2 * i + 1] = hermite(r, t);
+		}
+		remaining -= count;
+		return count;
+	}
+
+	// The kernel centred between frames j and j + 1, normalized so a constant passes as it is
+	void lowpass(int64_t j, float t, float* left, float* right) const {
+		float sumL = 0.f, sumR = 0.f, sumWeights = 0.f;
+		for (int k = 1 - sincReach; k <= sincReach; k++) {
+			double index = std::fabs(k - t) * sincScale;
+			int whole = (int) index;
+			if (whole >= (int) sinc.size() - 1)
+				continue;
+			float fraction = (float) (index - whole);
+			float weight = sinc[whole] + (sinc[whole + 1] - sinc[whole]) * fraction;
+			float l, r;
+			source.read(std::min(j + k, source.frames - 1), &l, &r);
+			sumL += l * weight;
+			sumR += r * weight;
+			sumWeights += weight;
+		}
+		*left = sumL / sumWeights;
+		*right = sumR / sumWeights;
+	}
+
+	static float hermite(const float* y, float t) {
+		float c1 = 0.5f * (y[2] - y[0]);
+		float c2 = y[0] - 2.5f * y[1] + 2.f * y[2] - 0.5f * y[3];
+		float c3 = 0.5f * (y[3] - y[0]) + 1.5f * (y[1] - y[2]);
+		return ((c3 * t + c2) * t + c1) * t + y[1];
+	}
+};
+
+struct WavWriter {
+	FILE* file = nullptr;
+	int channels = 2;
+	int sampleRate = 0;
+	int64_t frames = 0;
+	std::vector<float> interleaved;
+
+	~WavWriter() {
+		close();
+	}
+
+	static void writeLE(uint8_t* p, uint32_t x, int bytes) {
+		for (int i = 0; i < bytes; i++)
+			p[i] = (x >> (8 * i)) & 0xff;
+	}
+
+	void writeHeader() {
+		// Sizes are patched by close(); RIFF caps them at 4 GiB
+		uint64_t dataBytes = (uint64_t)frames * channels * 4;
+		if (dataBytes > 0xffffffffu - 36)
+			dataBytes = 0xffffffffu - 36;
+		uint8_t header[44];
+		std::memcpy(header, "RIFF", 4);
+		writeLE(header + 4, (uint32_t)(36 + dataBytes), 4);
+		std::memcpy(header + 8, "WAVEfmt ", 8);
+		writeLE(header + 16, 16, 4);
+		writeLE(header + 20, WAV_FLOAT, 2);
+		writeLE(header + 22, channels, 2);
+		writeLE(header + 24, sampleRate, 4);
+		writeLE(header + 28, sampleRate * channels * 4, 4);
+		writeLE(header + 32, channels * 4, 2);
+		writeLE(header + 34, 32, 2);
+		std::memcpy(header + 36, "data", 4);
+		writeLE(header + 40, (uint32_t)dataBytes, 4);
+		std::fwrite(header, 1, 44, file);
+	}
+
+	bool open(const std::string& path, int channels, int sampleRate, std::string* error) {
+		close();
+		file = std::fopen(path.c_str(), "wb");
+		if (!file) {
+			*error = "cannot create " + path;
+			return false;
+		}
+		this->channels = channels;
+		this->sampleRate = sampleRate;
+		frames = 0;
+		writeHeader();
+		return true;
+	}
+
+	// `right` is ignored for mono files
+	bool write(const float* left, const float* right, int count) {
+		if (!file)
+			return false;
+		interleaved.resize((size_t)count * channels);
+		for (int i = 0; i < count; i++) {
+			interleaved[i * channels] = left[i];
+			if (channels > 1)
+				interleaved[i * channels + 1] = right[i];
+		}
+		return writeInterleaved(interleaved.data(), count);
+	}
+
+	// `count` frames of `channels` samples each
+	bool writeInterleaved(const float* samples, int count) {
+		if (!file)
+			return false;
+		// Host byte order is little-endian on every platform Rack supports
+		size_t size = (size_t)count * channels;
+		size_t written = std::fwrite(samples, sizeof(float), size, file);
+		frames += written / channels;
+		return written == size;
+	}
+
+	bool close() {
+		if (!file)
+			return true;
+		std::fseek(file, 0, SEEK_SET);
+		writeHeader();
+		bool ok = !std::ferror(file);
+		ok &= std::fclose(file) == 0;
+		file = nullptr;
+		return ok;
+	}
+};
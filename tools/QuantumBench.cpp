@@ -0,0 +1,400 @@
+// Cache and TLB benchmark for delay-buffer layouts.
+//
+// Runs a reduced tap kernel (write, feedback, interpolated reads) over three layouts of the
+// delay history, and optionally every engine specialisation, with 1 to 256 instances
+// stepped one frame at a time in turn, the way Rack steps a patch. On Linux each run is
+// measured with perf_event_open: cycles, instructions, L1D and LLC read misses and dTLB
+// read misses. Elsewhere, or when perf events are not permitted, only wall time is reported.
+//
+// Usage:
+//   QuantumRender bench [options]
+//     -o FILE            JSON report (default bench.json)
+//     --max-instances N  largest instance count, powers of two from 1 (default 256)
+//     --engines          also run all 16 engine specialisations
+//     --oversampling     run each engine at 1x, 2x and 4x, to price the quality per instance
+//     --frames N         instance-frames per measurement (default 4000000)
+//
+// Layouts, for TAPS stereo taps of BUFFER_SIZE frames:
+//   planar       [tap][frame][L/R], as QuantumEngine stores delayBuffers
+//   interleaved  [frame][tap][L/R], one frame of every tap shares cache lines
+//   shared       [frame][L/R], a single history read by all taps with summed feedback
+// Layouts come from the heap unless suffixed _pool, which carves them from the plugin's
+// huge-page buffer pool like the engine does.
+
+#include "QuantumTool.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+enum BenchCounter {
+	COUNTER_CYCLES,
+	COUNTER_INSTRUCTIONS,
+	COUNTER_L1D_MISSES,
+	COUNTER_LLC_MISSES,
+	COUNTER_DTLB_MISSES,
+	COUNTERS_LEN
+};
+
+static const char* BENCH_COUNTER_NAMES[COUNTERS_LEN] = {"cycles", "instructions", "l1dMisses", "llcMisses", "dtlbMisses"};
+
+// One perf event group per measurement, scaled for multiplexing
+struct PerfCounters {
+	int fds[COUNTERS_LEN];
+	bool available[COUNTERS_LEN] = {};
+
+	PerfCounters() {
+		for (int c = 0; c < COUNTERS_LEN; c++)
+			fds[c] = -1;
+#ifdef __linux__
+		auto cache = [](uint64_t cache, uint64_t op, uint64_t result) {
+			return cache | (op << 8) | (result << 16);
+		};
+		const uint32_t types[COUNTERS_LEN] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE};
+		const uint64_t configs[COUNTERS_LEN] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS),
+			cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS),
+			cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS),
+		};
+		for (int c = 0; c < COUNTERS_LEN; c++) {
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[c];
+			attr.config = configs[c];
+			attr.disabled = 1;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			fds[c] = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+			available[c] = (fds[c] >= 0);
+		}
+#endif
+	}
+
+	~PerfCounters() {
+#ifdef __linux__
+		for (int c = 0; c < COUNTERS_LEN; c++) {
+			if (fds[c] >= 0)
+				close(fds[c]);
+		}
+#endif
+	}
+
+	void start() {
+#ifdef __linux__
+		for (int c = 0; c < COUNTERS_LEN; c++) {
+			if (available[c]) {
+				ioctl(fds[c], PERF_EVENT_IOC_RESET, 0);
+				ioctl(fds[c], PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+#endif
+	}
+
+	// Counts, or -1 for counters the kernel refused
+	void stop(double* values) {
+		for (int c = 0; c < COUNTERS_LEN; c++) {
+			values[c] = -1.0;
+#ifdef __linux__
+			if (!available[c])
+				continue;
+			ioctl(fds[c], PERF_EVENT_IOC_DISABLE, 0);
+			uint64_t data[3];
+			if (read(fds[c], data, sizeof(data)) == sizeof(data) && data[2] > 0)
+				values[c] = (double)data[0] * data[1] / data[2];
+#endif
+		}
+	}
+};
+
+static constexpr int BENCH_TAPS = 6;
+static constexpr int BENCH_BUFFER_SIZE = 16000;
+
+struct PlanarLayout {
+	static constexpr const char* NAME = "planar";
+	static constexpr int HISTORIES = BENCH_TAPS;
+	static size_t index(int tap, int frame) {
+		return ((size_t)tap * BENCH_BUFFER_SIZE + frame) * 2;
+	}
+};
+
+struct InterleavedLayout {
+	static constexpr const char* NAME = "interleaved";
+	static constexpr int HISTORIES = BENCH_TAPS;
+	static size_t index(int tap, int frame) {
+		return ((size_t)frame * BENCH_TAPS + tap) * 2;
+	}
+};
+
+struct SharedLayout {
+	static constexpr const char* NAME = "shared";
+	static constexpr int HISTORIES = 1;
+	// Every tap reads the one history
+	static size_t index(int, int frame) {
+		return (size_t)frame * 2;
+	}
+};
+
+// The engine's per-frame memory traffic without its control logic
+template <typename TLayout>
+struct LayoutKernel {
+	float* history;
+	size_t historyBytes;
+	bool pooled;
+	float delays[BENCH_TAPS];
+	float gains[BENCH_TAPS];
+	int writeIndex = 0;
+
+	// History from the shared huge-page pool, or from the heap as a plain vector would be
+	LayoutKernel(uint32_t seed, bool pooled) : pooled(pooled) {
+		historyBytes = sizeof(float) * TLayout::HISTORIES * BENCH_BUFFER_SIZE * 2;
+		history = (float*) (pooled ? quantumBufferPool().allocate(historyBytes) : std::malloc(historyBytes));
+		std::memset(history, 0, historyBytes);
+		std::mt19937 rng(seed);
+		std::uniform_real_distribution<float> uniform(0.f, 1.f);
+		for (int t = 0; t < BENCH_TAPS; t++) {
+			// Spread over the buffer like a wide delay time and spread setting
+			delays[t] = 10.f + (t + uniform(rng)) / BENCH_TAPS * (BENCH_BUFFER_SIZE - 20);
+			gains[t] = 1.f / BENCH_TAPS;
+		}
+	}
+
+	~LayoutKernel() {
+		if (pooled)
+			quantumBufferPool().release(history, historyBytes);
+		else
+			std::free(history);
+	}
+
+	float_4 read(int tap) const {
+		float pos = writeIndex - delays[tap];
+		if (pos < 0.f)
+			pos += BENCH_BUFFER_SIZE;
+		int i0 = (int)pos;
+		int i1 = wrapIndex(i0 + 1, BENCH_BUFFER_SIZE);
+		float frac = pos - i0;
+		int h = (TLayout::HISTORIES == 1) ? 0 : tap;
+		const float* x0 = &history[TLayout::index(h, i0)];
+		const float* x1 = &history[TLayout::index(h, i1)];
+		return float_4(x0[0] + (x1[0] - x0[0]) * frac, x0[1] + (x1[1] - x0[1]) * frac, 0.f, 0.f);
+	}
+
+	float step(float inL, float inR) {
+		float_4 out = 0.f;
+		float_4 feedback[BENCH_TAPS];
+		for (int t = 0; t < BENCH_TAPS; t++) {
+			feedback[t] = read(t);
+			out += feedback[t] * gains[t];
+		}
+		if (TLayout::HISTORIES == 1) {
+			float* frame = &history[TLayout::index(0, writeIndex)];
+			frame[0] = inL + out[0] * 0.3f;
+			frame[1] = inR + out[1] * 0.3f;
+		} else {
+			for (int t = 0; t < BENCH_TAPS; t++) {
+				float* frame = &history[TLayout::index(t, writeIndex)];
+				frame[0] = inL + feedback[t][0] * 0.3f;
+				frame[1] = inR + feedback[t][1] * 0.3f;
+			}
+		}
+		writeIndex = wrapIndex(writeIndex + 1, BENCH_BUFFER_SIZE);
+		return out[0] + out[1];
+	}
+};
+
+struct BenchResult {
+	std::string name;
+	int instances;
+	int64_t instanceFrames;
+	double nsPerFrame;
+	double counters[COUNTERS_LEN];
+};
+
+// Steps every instance one frame at a time, round robin like Rack's engine
+template <typename TInstance, typename TStep>
+static BenchResult measure(const std::string& name, std::vector<TInstance>& instances, int64_t instanceFrames, TStep stepInstance) {
+	int count = instances.size();
+	int64_t frames = std::max<int64_t>(instanceFrames / count, BENCH_BUFFER_SIZE);
+	float sink = 0.f;
+	uint32_t noise = 1;
+
+	// Warm up: fill every history once so the first pass is not all compulsory misses
+	for (int64_t f = 0; f < BENCH_BUFFER_SIZE; f++) {
+		noise = noise * 1664525u + 1013904223u;
+		float x = (noise >> 9) * (1.f / 4194304.f) - 1.f;
+		for (TInstance& instance : instances)
+			sink += stepInstance(instance, x);
+	}
+
+	PerfCounters counters;
+	BenchResult result;
+	result.name = name;
+	result.instances = count;
+	result.instanceFrames = frames * count;
+
+	auto start = std::chrono::steady_clock::now();
+	counters.start();
+	for (int64_t f = 0; f < frames; f++) {
+		noise = noise * 1664525u + 1013904223u;
+		float x = (noise >> 9) * (1.f / 4194304.f) - 1.f;
+		for (TInstance& instance : instances)
+			sink += stepInstance(instance, x);
+	}
+	counters.stop(result.counters);
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	result.nsPerFrame = elapsed * 1e9 / result.instanceFrames;
+	// Keep the work observable
+	if (sink == 12345.f)
+		std::printf(" ");
+	return result;
+}
+
+template <typename TLayout>
+static BenchResult benchLayout(int instanceCount, int64_t instanceFrames, bool pooled) {
+	std::vector<std::unique_ptr<LayoutKernel<TLayout>>> instances;
+	for (int i = 0; i < instanceCount; i++)
+		instances.emplace_back(new LayoutKernel<TLayout>(i + 1, pooled));
+	std::string name = std::string(TLayout::NAME) + (pooled ? "_pool" : "");
+	return measure(name, instances, instanceFrames, [](std::unique_ptr<LayoutKernel<TLayout>>& kernel, float x) {
+		return kernel->step(x, -x);
+	});
+}
+
+static BenchResult benchEngine(int taps, int interpolation, int sampleFormat, int oversampling, int instanceCount, int64_t instanceFrames) {
+	static const char* interpolationNames[] = {"linear", "cubic"};
+	static const char* formatNames[] = {"float", "half"};
+	std::vector<std::unique_ptr<QuantumEngineBase>> instances;
+	for (int i = 0; i < instanceCount; i++) {
+		instances.emplace_back(createQuantumEngine(taps, interpolation, sampleFormat, oversampling));
+		prepareEngine(instances.back().get(), i + 1, 48000.f);
+		// Long delays with full spread, the worst case for locality
+		instances.back()->controls.delayTime = 0.15f;
+		instances.back()->controls.spread = 1.f;
+	}
+	char name[64];
+	std::string suffix = (oversampling > 1) ? "_x" + std::to_string(oversampling) : "";
+	std::snprintf(name, sizeof(name), "engine_%d_%s_%s%s", taps, interpolationNames[interpolation], formatNames[sampleFormat], suffix.c_str());
+	return measure(name, instances, instanceFrames, [](std::unique_ptr<QuantumEngineBase>& engine, float x) {
+		QuantumFrame frame;
+		frame.inL = x;
+		frame.inR = -x;
+		engine->processFrame(frame);
+		return frame.outL;
+	});
+}
+
+static void printResult(const BenchResult& r) {
+	double ipc = (r.counters[COUNTER_CYCLES] > 0) ? r.counters[COUNTER_INSTRUCTIONS] / r.counters[COUNTER_CYCLES] : 0.0;
+	std::printf("%-28s %4d instances  %7.1f ns/frame", r.name.c_str(), r.instances, r.nsPerFrame);
+	if (r.counters[COUNTER_CYCLES] >= 0)
+		std::printf("  IPC %.2f", ipc);
+	for (int c = COUNTER_L1D_MISSES; c < COUNTERS_LEN; c++) {
+		if (r.counters[c] >= 0)
+			std::printf("  %s %.2f/frame", BENCH_COUNTER_NAMES[c], r.counters[c] / r.instanceFrames);
+	}
+	std::printf("\n");
+}
+
+static bool writeReport(const std::string& path, const std::vector<BenchResult>& results) {
+	FILE* file = std::fopen(path.c_str(), "w");
+	if (!file)
+		return false;
+	std::fprintf(file, "{\n\t\"taps\": %d,\n\t\"bufferFrames\": %d,\n\t\"results\": [\n", BENCH_TAPS, BENCH_BUFFER_SIZE);
+	for (size_t i = 0; i < results.size(); i++) {
+		const BenchResult& r = results[i];
+		std::fprintf(file, "\t\t{\"name\": \"%s\", \"instances\": %d, \"instanceFrames\": %lld, \"nsPerFrame\": %.3f",
+			r.name.c_str(), r.instances, (long long)r.instanceFrames, r.nsPerFrame);
+		for (int c = 0; c < COUNTERS_LEN; c++) {
+			// null when the counter is unavailable
+			if (r.counters[c] >= 0)
+				std::fprintf(file, ", \"%sPerFrame\": %.4f", BENCH_COUNTER_NAMES[c], r.counters[c] / r.instanceFrames);
+			else
+				std::fprintf(file, ", \"%sPerFrame\": null", BENCH_COUNTER_NAMES[c]);
+		}
+		if (r.counters[COUNTER_CYCLES] > 0 && r.counters[COUNTER_INSTRUCTIONS] >= 0)
+			std::fprintf(file, ", \"ipc\": %.3f", r.counters[COUNTER_INSTRUCTIONS] / r.counters[COUNTER_CYCLES]);
+		else
+			std::fprintf(file, ", \"ipc\": null");
+		std::fprintf(file, "}%s\n", (i + 1 < results.size()) ? "," : "");
+	}
+	std::fprintf(file, "\t]\n}\n");
+	return std::fclose(file) == 0;
+}
+
+static int benchUsage() {
+	std::fprintf(stderr, "usage: QuantumRender bench [-o report.json] [--max-instances N] [--engines] [--oversampling] [--frames N]\n");
+	return 2;
+}
+
+int benchMain(int argc, char** argv) {
+	std::string reportPath = "bench.json";
+	int maxInstances = 256;
+	bool engines = false;
+	int maxOversampling = 1;
+	int64_t instanceFrames = 4000000;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (arg == "-o" && hasValue)
+			reportPath = argv[++i];
+		else if (arg == "--max-instances" && hasValue)
+			maxInstances = clamp(std::atoi(argv[++i]), 1, 4096);
+		else if (arg == "--engines")
+			engines = true;
+		else if (arg == "--oversampling")
+			maxOversampling = 4;
+		else if (arg == "--frames" && hasValue)
+			instanceFrames = std::max(1LL, std::atoll(argv[++i]));
+		else
+			return benchUsage();
+	}
+
+	{
+		PerfCounters probe;
+		for (int c = 0; c < COUNTERS_LEN; c++) {
+			if (!probe.available[c])
+				std::fprintf(stderr, "counter %s unavailable, reported as null\n", BENCH_COUNTER_NAMES[c]);
+		}
+	}
+
+	// Single-threaded on purpose: counters follow the calling thread
+	std::vector<BenchResult> results;
+	for (int instances = 1; instances <= maxInstances; instances *= 2) {
+		results.push_back(benchLayout<PlanarLayout>(instances, instanceFrames, false));
+		printResult(results.back());
+		results.push_back(benchLayout<PlanarLayout>(instances, instanceFrames, true));
+		printResult(results.back());
+		results.push_back(benchLayout<InterleavedLayout>(instances, instanceFrames, false));
+		printResult(results.back());
+		results.push_back(benchLayout<SharedLayout>(instances, instanceFrames, false));
+		printResult(results.back());
+
+		if (engines) {
+			for (int t = 0; t < QUANTUM_TAP_COUNTS_LEN; t++) {
+				for (int interpolation = 0; interpolation < INTERP_LEN; interpolation++) {
+					for (int format = 0; format < SAMPLE_FORMATS_LEN; format++) {
+						for (int oversampling = 1; oversampling <= maxOversampling; oversampling *= 2) {
+							results.push_back(benchEngine(QUANTUM_TAP_COUNTS[t], interpolation, format, oversampling, instances, instanceFrames));
+							printResult(results.back());
+						}
+					}
+				}
+			}
+		}
+	}
+
+	if (!writeReport(reportPath, results)) {
+		std::fprintf(stderr, "cannot write %s\n", reportPath.c_str());
+		return 1;
+	}
+	std::printf("report written to %s, %d of %d pool chunks on huge pages\n", reportPath.c_str(), quantumBufferPool().hugeChunks(), quantumBufferPool().chunkCount.load());
+	return 0;
+}
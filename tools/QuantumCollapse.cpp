@@ -0,0 +1,215 @@
+// Collapse timing check.
+//
+// Measures how many frames after its trigger a collapse reaches the output. Two copies of an
+// engine with the same seed take the same DC input; one is collapsed at frame T. With every tap
+// reading the same level, their output difference is the change of the tap mix alone: a step
+// for a gliding collapse, a ramp over one control block for a hard one.
+//
+// A plain engine's outputs must part exactly on frame T. Behind the oversampling decimators
+// the step is smeared across their length, so the collapse counts as arrived where the
+// difference reaches half its settled level, the group delay of a linear-phase filter. That
+// has to trail the plain engine's crossing by getMixLatency(), which rounds the 4x decimator's
+// extra half frame to a whole one. Triggers are placed at every phase of the control block, in both
+// modes, for every tap count. A hard collapse whose weights did not snap fails too.
+//
+// Usage:
+//   QuantumRender collapse [-s SEED] [-j N]
+
+#include "QuantumTool.hpp"
+
+static constexpr int COLLAPSE_SAMPLE_RATE = 48000;
+// Fills the taps' history and settles the oversampling filters, in whole control blocks
+static constexpr int COLLAPSE_WARMUP = 320 * AUTOMATION_INTERVAL;
+static constexpr int COLLAPSE_PHASE_STEP = 5;
+// The difference is settled here, before the next control update moves it again: a gliding
+// collapse is a step at the trigger, a hard one ends its ramp on the block's last frame
+static constexpr int COLLAPSE_GLIDE_SETTLED = AUTOMATION_INTERVAL * 3 / 4;
+static constexpr int COLLAPSE_HARD_SETTLED = AUTOMATION_INTERVAL - 1;
+// Longer than any settling frame plus mix latency looked for
+static constexpr int COLLAPSE_WINDOW = 4 * AUTOMATION_INTERVAL;
+static constexpr float COLLAPSE_INPUT_L = 2.f;
+static constexpr float COLLAPSE_INPUT_R = -1.f;
+// getMixLatency() rounding plus interpolation error in the measured crossings
+static constexpr float COLLAPSE_LATENCY_TOLERANCE = 0.6f;
+// Snapped weights keep the collapse's 0.7 on the dominant tap, less one glide step
+static constexpr float COLLAPSE_SNAPPED_WEIGHT = 0.6f;
+
+struct CollapseCase {
+	int taps;
+	int oversampling;
+	bool hard;
+	int phase; // trigger frame within the control block
+};
+
+struct CollapseResult {
+	bool ok = true;
+	float latency = 0.f; // frames the collapse trails the plain engine's
+	std::string message;
+};
+
+struct CollapseTrace {
+	int onset = -1; // first frame from the trigger where the outputs part, -1 if they never do
+	float crossing = -1.f; // frames from the trigger to half the settled difference, interpolated
+	int mixLatency = 0;
+	std::string error;
+};
+
+static void prepareCollapseEngine(QuantumEngineBase* engine, uint32_t seed, bool hard) {
+	prepareEngine(engine, seed, COLLAPSE_SAMPLE_RATE);
+	QuantumControls& controls = engine->controls;
+	// Wet only, no feedback or chaos. Probability just below the middle keeps most of the
+	// collapse in the weights, where the peaked half would reshape it away.
+	controls.mix = 1.f;
+	controls.feedback = 0.f;
+	controls.chaos = 0.f;
+	controls.probability = 0.45f;
+	controls.hardCollapse = hard;
+}
+
+static CollapseTrace traceCollapse(const CollapseCase& c, int oversampling, uint32_t seed) {
+	CollapseTrace trace;
+	std::unique_ptr<QuantumEngineBase> reference(createQuantumEngine(c.taps, INTERP_LINEAR, SAMPLE_FLOAT, oversampling));
+	std::unique_ptr<QuantumEngineBase> collapsed(createQuantumEngine(c.taps, INTERP_LINEAR, SAMPLE_FLOAT, oversampling));
+	prepareCollapseEngine(reference.get(), seed, c.hard);
+	prepareCollapseEngine(collapsed.get(), seed, c.hard);
+	trace.mixLatency = collapsed->getMixLatency();
+
+	// An oversampled engine's control block spans as many host frames as a plain one's
+	int trigger = COLLAPSE_WARMUP + c.phase;
+	std::vector<float> differenceL, differenceR;
+	QuantumFrame a, b;
+	for (int i = 0; i < trigger + COLLAPSE_WINDOW; i++) {
+		a.inL = b.inL = COLLAPSE_INPUT_L;
+		a.inR = b.inR = COLLAPSE_INPUT_R;
+		if (i == trigger)
+			collapsed->collapse();
+		reference->processFrame(a);
+		collapsed->processFrame(b);
+
+		if (i == trigger && c.hard) {
+			const float* weights = collapsed->getProbWeights();
+			float dominant = *std::max_element(weights, weights + c.taps);
+			if (dominant < COLLAPSE_SNAPPED_WEIGHT) {
+				trace.error = "hard collapse left the dominant weight at " + std::to_string(dominant);
+				return trace;
+			}
+		}
+		bool parted = (a.outL != b.outL || a.outR != b.outR);
+		if (i < trigger) {
+			if (parted) {
+				trace.error = "outputs parted " + std::to_string(trigger - i) + " frames before the trigger";
+				return trace;
+			}
+			continue;
+		}
+		if (parted && trace.onset < 0)
+			trace.onset = i - trigger;
+		differenceL.push_back(b.outL - a.outL);
+		differenceR.push_back(b.outR - a.outR);
+	}
+
+	// The channel the mix moved most, measured where it has settled behind the decimators
+	int settled = (c.hard ? COLLAPSE_HARD_SETTLED : COLLAPSE_GLIDE_SETTLED) + trace.mixLatency;
+	const std::vector<float>& difference = (std::fabs(differenceL[settled]) >= std::fabs(differenceR[settled])) ? differenceL : differenceR;
+	float level = difference[settled];
+	if (level == 0.f) {
+		trace.error = "collapse never reached the output";
+		return trace;
+	}
+	float previous = 0.f;
+	for (int i = 0; i <= settled; i++) {
+		float fraction = difference[i] / level;
+		if (fraction >= 0.5f) {
+			trace.crossing = (i > 0) ? i - (fraction - 0.5f) / (fraction - previous) : 0.f;
+			break;
+		}
+		previous = fraction;
+	}
+	return trace;
+}
+
+static CollapseResult measureCollapse(const CollapseCase& c, uint32_t seed) {
+	CollapseResult result;
+	CollapseTrace plain = traceCollapse(c, 1, seed);
+	CollapseTrace trace = (c.oversampling > 1) ? traceCollapse(c, c.oversampling, seed) : plain;
+	if (!plain.error.empty() || !trace.error.empty()) {
+		result.ok = false;
+		result.message = trace.error.empty() ? "plain engine: " + plain.error : trace.error;
+		return result;
+	}
+	if (plain.onset != 0) {
+		result.ok = false;
+		result.message = "plain engine's outputs parted " + std::to_string(plain.onset) + " frames late";
+		return result;
+	}
+
+	result.latency = trace.crossing - plain.crossing;
+	if (std::fabs(result.latency - trace.mixLatency) > COLLAPSE_LATENCY_TOLERANCE) {
+		char message[128];
+		std::snprintf(message, sizeof(message), "collapse arrived %.2f frames late, expected %d", result.latency, trace.mixLatency);
+		result.ok = false;
+		result.message = message;
+	}
+	return result;
+}
+
+static int collapseUsage() {
+	std::fprintf(stderr, "usage: QuantumRender collapse [-s seed] [-j threads]\n");
+	return 2;
+}
+
+int collapseMain(int argc, char** argv) {
+	uint32_t seed = 1;
+	int threads = 0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (arg == "-s" && hasValue)
+			seed = std::strtoul(argv[++i], nullptr, 0);
+		else if (arg == "-j" && hasValue)
+			threads = std::atoi(argv[++i]);
+		else
+			return collapseUsage();
+	}
+
+	static const int oversamplings[] = {1, 2, 4};
+	std::vector<CollapseCase> cases;
+	for (int t = 0; t < QUANTUM_TAP_COUNTS_LEN; t++) {
+		for (int oversampling : oversamplings) {
+			for (int hard = 0; hard < 2; hard++) {
+				for (int phase = 0; phase < AUTOMATION_INTERVAL; phase += COLLAPSE_PHASE_STEP) {
+					CollapseCase c;
+					c.taps = QUANTUM_TAP_COUNTS[t];
+					c.oversampling = oversampling;
+					c.hard = hard;
+					c.phase = phase;
+					cases.push_back(c);
+				}
+			}
+		}
+	}
+
+	threads = (threads > 0) ? threads : (int)std::thread::hardware_concurrency();
+	WorkStealingPool pool(clamp(threads, 1, (int)cases.size()));
+	std::vector<CollapseResult> results(cases.size());
+	for (size_t i = 0; i < cases.size(); i++) {
+		pool.submit([&, i]() {
+			results[i] = measureCollapse(cases[i], seed + (uint32_t)i);
+		});
+	}
+	pool.run();
+
+	int failures = 0;
+	float maxLatency[5] = {}; // per oversampling factor
+	for (size_t i = 0; i < cases.size(); i++) {
+		const CollapseCase& c = cases[i];
+		maxLatency[c.oversampling] = std::max(maxLatency[c.oversampling], results[i].latency);
+		if (!results[i].ok) {
+			std::fprintf(stderr, "FAIL %d taps %dx %s phase %d: %s\n", c.taps, c.oversampling, c.hard ? "hard" : "glide", c.phase, results[i].message.c_str());
+			failures++;
+		}
+	}
+	std::printf("%d triggers, max latency %.2f/%.2f/%.2f frames at 1x/2x/4x, %d failed\n", (int)cases.size(), maxLatency[1], maxLatency[2], maxLatency[4], failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,254 @@
+// Fuzzer for the engine's input handling and fault recovery.
+//
+// Each iteration builds a random engine specialisation and drives it with random control
+// changes, collapses, expander bank counts and hostile audio: NaN, infinities, huge values,
+// denormals, DC and full-scale noise. Every output sample must stay finite and bounded, and
+// once the input is clean again the engine must stop reporting faults.
+//
+// Usage:
+//   QuantumRender fuzz [-n ITERATIONS] [-s SEED] [-j N]
+// Failing iterations print their seed; rerun one alone with -n 1 -s SEED.
+
+#include "QuantumTool.hpp"
+
+// Dry input is clamped to 100 V and the wet signal to 10 V
+static constexpr float FUZZ_OUTPUT_LIMIT = 110.f;
+static constexpr int FUZZ_BLOCKS = 400;
+static constexpr int FUZZ_MAX_BLOCK = 1024;
+// Covers the longest delay buffer, a multiple of FUZZ_MAX_BLOCK
+static constexpr int FUZZ_HISTORY_FRAMES = 16 * FUZZ_MAX_BLOCK;
+
+enum FuzzSignal {
+	FUZZ_SILENCE,
+	FUZZ_NOISE,
+	FUZZ_DC,
+	FUZZ_SINE,
+	FUZZ_HOSTILE,
+	FUZZ_SIGNALS_LEN
+};
+
+struct FuzzResult {
+	bool ok = true;
+	uint32_t recoveries = 0;
+	std::string message;
+};
+
+static float hostileValue(std::mt19937& rng) {
+	static const float values[] = {
+		NAN, -NAN, INFINITY, -INFINITY, 1e30f, -1e30f, 3.4e38f, 1e-40f, -1e-40f, 1e4f, -1e4f,
+	};
+	return values[rng() % (sizeof(values) / sizeof(values[0]))];
+}
+
+static void fillSignal(std::mt19937& rng, int signal, float* left, float* right, int frames, float* phase) {
+	std::uniform_real_distribution<float> uniform(-1.f, 1.f);
+	float level = 10.f * std::abs(uniform(rng));
+	float dc = 10.f * uniform(rng);
+	float step = 0.3f * std::abs(uniform(rng));
+
+	for (int i = 0; i < frames; i++) {
+		switch (signal) {
+			case FUZZ_SILENCE: left[i] = right[i] = 0.f; break;
+			case FUZZ_NOISE: left[i] = level * uniform(rng); right[i] = level * uniform(rng); break;
+			case FUZZ_DC: left[i] = right[i] = dc; break;
+			case FUZZ_SINE: *phase += step; left[i] = level * std::sin(*phase); right[i] = level * std::cos(*phase); break;
+			default: left[i] = 10.f * uniform(rng); right[i] = 10.f * uniform(rng); break;
+		}
+	}
+	if (signal == FUZZ_HOSTILE) {
+		int count = 1 + rng() % 8;
+		for (int n = 0; n < count; n++) {
+			int i = rng() % frames;
+			(rng() & 1 ? left : right)[i] = hostileValue(rng);
+		}
+	}
+}
+
+// Inputs are sanitised before they reach the history, so faults are injected straight into it
+// through the expander view of the buffers to exercise recovery
+static void poisonHistory(std::mt19937& rng, QuantumEngineBase* engine) {
+	QuantumBankMessage message;
+	engine->fillBankMessage(&message);
+	size_t index = rng() % ((size_t)message.bufferCount * message.bufferSize * 2);
+	if (message.sampleFormat == SAMPLE_HALF)
+		((uint16_t*) message.delayBuffers)[index] = (rng() & 1) ? 0x7e00 : 0x7c00; // NaN or Inf
+	else
+		((float*) message.delayBuffers)[index] = hostileValue(rng);
+}
+
+static void randomizeControls(std::mt19937& rng, QuantumControls& controls) {
+	std::uniform_real_distribution<float> unit(0.f, 1.f);
+	controls.delayTime = unit(rng);
+	controls.spread = unit(rng);
+	controls.probability = unit(rng);
+	controls.feedback = 0.95f * unit(rng);
+	controls.mix = unit(rng);
+	controls.chaos = unit(rng);
+	controls.width = unit(rng);
+	controls.panMode = rng() % PAN_MODES_LEN;
+	controls.midSide = rng() & 1;
+	controls.freeze = (rng() % 4 == 0);
+	controls.granular = rng() & 1;
+	controls.grainSize = unit(rng);
+	controls.grainDensity = unit(rng);
+	controls.varispeed = rng() & 1;
+	controls.multiband = rng() & 1;
+	controls.spectral = (rng() % 4 == 0);
+	controls.feedbackTone = (rng() & 1) ? unit(rng) : 0.f;
+	controls.toneSpread = unit(rng);
+	controls.modDepth = (rng() & 1) ? unit(rng) : 0.f;
+	controls.modRate = unit(rng);
+	controls.modShape = rng() % LFO_SHAPES_LEN;
+	controls.hardCollapse = rng() & 1;
+	controls.numBanks = rng() % (QUANTUM_MAX_BANKS + 1);
+}
+
+static bool checkOutput(const float* out, int frames, float limit, const char* what, FuzzResult* result, int block) {
+	for (int i = 0; i < frames; i++) {
+		if (!(std::fabs(out[i]) <= limit)) {
+			char message[128];
+			std::snprintf(message, sizeof(message), "%s %g at block %d frame %d", what, out[i], block, i);
+			result->ok = false;
+			result->message = message;
+			return false;
+		}
+	}
+	return true;
+}
+
+static FuzzResult fuzzIteration(uint32_t seed) {
+	static const float sampleRates[] = {8000.f, 44100.f, 48000.f, 96000.f, 192000.f};
+	FuzzResult result;
+	std::mt19937 rng(seed);
+
+	int taps = QUANTUM_TAP_COUNTS[rng() % QUANTUM_TAP_COUNTS_LEN];
+	int interpolation = rng() % INTERP_LEN;
+	int sampleFormat = rng() % SAMPLE_FORMATS_LEN;
+	int oversampling = (rng() % 4 == 0) ? 2 << (rng() & 1) : 1;
+	std::unique_ptr<QuantumEngineBase> engine(createQuantumEngine(taps, interpolation, sampleFormat, oversampling));
+	prepareEngine(engine.get(), seed, sampleRates[rng() % 5]);
+
+	float inL[FUZZ_MAX_BLOCK], inR[FUZZ_MAX_BLOCK], outL[FUZZ_MAX_BLOCK], outR[FUZZ_MAX_BLOCK];
+	float tapVoltages[16] = {};
+	float phase = 0.f;
+
+	// Hostile phase
+	for (int block = 0; block < FUZZ_BLOCKS; block++) {
+		int frames = 1 + rng() % FUZZ_MAX_BLOCK;
+		if (rng() % 4 == 0) {
+			randomizeControls(rng, engine->controls);
+			if (engine->controls.spectral)
+				engine->prepareSpectral();
+		}
+		if (rng() % 16 == 0)
+			engine->collapse();
+		if (rng() % 8 == 0)
+			poisonHistory(rng, engine.get());
+		fillSignal(rng, rng() % FUZZ_SIGNALS_LEN, inL, inR, frames, &phase);
+
+		if (rng() & 1) {
+			engine->processBlock(inL, (rng() % 4) ? inR : nullptr, outL, outR, frames);
+		} else {
+			// Per-frame path with per-tap outputs, as the Rack module drives it
+			QuantumFrame frame;
+			frame.taps = tapVoltages;
+			frame.stereoTaps = rng() & 1;
+			int tapChannels = frame.stereoTaps ? std::min(taps * 2, 16) : taps;
+			for (int i = 0; i < frames; i++) {
+				frame.inL = inL[i];
+				frame.inR = inR[i];
+				engine->processFrame(frame);
+				outL[i] = frame.outL;
+				outR[i] = frame.outR;
+				// Taps carry raw history, which only has to stay below the fault limit
+				if (!checkOutput(tapVoltages, tapChannels, QUANTUM_FAULT_LIMIT, "tap output", &result, block))
+					return result;
+			}
+		}
+		if (!checkOutput(outL, frames, FUZZ_OUTPUT_LIMIT, "left output", &result, block) || !checkOutput(outR, frames, FUZZ_OUTPUT_LIMIT, "right output", &result, block))
+			return result;
+	}
+
+	// Clean phase: once the write head has overwritten the whole history, no fault may recur
+	engine->controls.freeze = false;
+	for (int frame = 0; frame < 3 * FUZZ_HISTORY_FRAMES; frame += FUZZ_MAX_BLOCK) {
+		if (frame == 2 * FUZZ_HISTORY_FRAMES)
+			result.recoveries = engine->faultRecoveries;
+		fillSignal(rng, FUZZ_NOISE, inL, inR, FUZZ_MAX_BLOCK, &phase);
+		engine->processBlock(inL, inR, outL, outR, FUZZ_MAX_BLOCK);
+		if (!checkOutput(outL, FUZZ_MAX_BLOCK, FUZZ_OUTPUT_LIMIT, "left output", &result, FUZZ_BLOCKS) || !checkOutput(outR, FUZZ_MAX_BLOCK, FUZZ_OUTPUT_LIMIT, "right output", &result, FUZZ_BLOCKS))
+			return result;
+	}
+	if (engine->faultRecoveries != result.recoveries) {
+		result.ok = false;
+		result.message = "faults keep recurring on clean input";
+		return result;
+	}
+
+	// Every tap must be live again, a pair left muted would read as silence here
+	float tapPeaks[16] = {};
+	QuantumFrame frame;
+	frame.taps = tapVoltages;
+	for (int i = 0; i < FUZZ_MAX_BLOCK; i++) {
+		frame.inL = inL[i];
+		frame.inR = inR[i];
+		engine->processFrame(frame);
+		for (int t = 0; t < std::min(taps, 16); t++)
+			tapPeaks[t] = std::max(tapPeaks[t], std::fabs(tapVoltages[t]));
+	}
+	for (int t = 0; t < std::min(taps, 16); t++) {
+		if (tapPeaks[t] == 0.f) {
+			result.ok = false;
+			result.message = "tap " + std::to_string(t) + " silent after recovery";
+			return result;
+		}
+	}
+	result.recoveries = engine->faultRecoveries;
+	return result;
+}
+
+static int fuzzUsage() {
+	std::fprintf(stderr, "usage: QuantumRender fuzz [-n iterations] [-s seed] [-j threads]\n");
+	return 2;
+}
+
+int fuzzMain(int argc, char** argv) {
+	int iterations = 1000;
+	uint32_t seed = 1;
+	int threads = 0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (arg == "-n" && hasValue)
+			iterations = std::max(1, std::atoi(argv[++i]));
+		else if (arg == "-s" && hasValue)
+			seed = std::strtoul(argv[++i], nullptr, 0);
+		else if (arg == "-j" && hasValue)
+			threads = std::atoi(argv[++i]);
+		else
+			return fuzzUsage();
+	}
+
+	threads = (threads > 0) ? threads : (int)std::thread::hardware_concurrency();
+	WorkStealingPool pool(clamp(threads, 1, iterations));
+	std::vector<FuzzResult> results(iterations);
+	for (int i = 0; i < iterations; i++) {
+		pool.submit([&, i]() {
+			results[i] = fuzzIteration(seed + i);
+		});
+	}
+	pool.run();
+
+	int failures = 0;
+	uint64_t recoveries = 0;
+	for (int i = 0; i < iterations; i++) {
+		recoveries += results[i].recoveries;
+		if (!results[i].ok) {
+			std::fprintf(stderr, "FAIL seed %u: %s\n", seed + i, results[i].message.c_str());
+			failures++;
+		}
+	}
+	std::printf("%d iterations, %llu tap pairs recovered, %d failed\n", iterations, (unsigned long long)recoveries, failures);
+	return failures ? 1 : 0;
+}
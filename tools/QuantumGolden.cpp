@@ -0,0 +1,274 @@
+// Golden-output regression check.
+//
+// Renders a fixed set of stimuli through every engine specialisation with fixed seeds and
+// compares the result with references recorded from a trusted build. Exits non-zero on any
+// mismatch, so it can gate optimisation work in CI.
+//
+// Usage:
+//   QuantumRender golden [options]
+//     -d DIR        reference directory (default golden)
+//     --write       record references instead of comparing, creating DIR if needed
+//     --tier TIER   exact   bit-identical output (default)
+//                   simd    max error 1e-5 of full scale, for reassociated vector math
+//                   fast    max error 1e-3 and error RMS below -80 dBFS, for approximations
+//     -j N          worker threads (default: all cores)
+//
+// References depend on the standard library's random distributions, so record them on the
+// platform and toolchain that will run the comparison.
+
+#include "QuantumTool.hpp"
+
+enum GoldenStimulus {
+	GOLDEN_IMPULSE,
+	GOLDEN_SWEEP,
+	GOLDEN_NOISE_BURSTS,
+	GOLDEN_COLLAPSE_TRAIN,
+	GOLDEN_STIMULI_LEN
+};
+
+static const char* GOLDEN_STIMULUS_NAMES[] = {"impulse", "sweep", "bursts", "collapse"};
+
+static constexpr int GOLDEN_SAMPLE_RATE = 48000;
+static constexpr int GOLDEN_FRAMES = GOLDEN_SAMPLE_RATE * 3 / 2;
+static constexpr uint32_t GOLDEN_SEED = 0x5eed;
+
+enum GoldenTier {
+	TIER_EXACT,
+	TIER_SIMD,
+	TIER_FAST
+};
+
+struct GoldenCase {
+	std::string name;
+	int stimulus;
+	int taps;
+	int interpolation;
+	int sampleFormat;
+	Automation automation;
+};
+
+struct GoldenResult {
+	bool ok = false;
+	std::string message;
+};
+
+// Deterministic test signals in volts
+static void generateStimulus(int stimulus, std::vector<float>& left, std::vector<float>& right) {
+	left.assign(GOLDEN_FRAMES, 0.f);
+	right.assign(GOLDEN_FRAMES, 0.f);
+	uint32_t state = 12345;
+	auto noise = [&]() {
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) / 8388608.f - 1.f;
+	};
+
+	switch (stimulus) {
+		case GOLDEN_IMPULSE: {
+			left[0] = 5.f;
+			right[0] = 5.f;
+		} break;
+		case GOLDEN_SWEEP: {
+			// 20 Hz to 20 kHz exponential sweep over the first second, right channel in quadrature
+			double f0 = 20.0, f1 = 20000.0, duration = 1.0;
+			double k = std::log(f1 / f0);
+			for (int i = 0; i < GOLDEN_SAMPLE_RATE; i++) {
+				double t = (double)i / GOLDEN_SAMPLE_RATE;
+				double phase = 2.0 * M_PI * f0 * duration / k * (std::exp(t / duration * k) - 1.0);
+				left[i] = 5.f * (float)std::sin(phase);
+				right[i] = 5.f * (float)std::cos(phase);
+			}
+		} break;
+		case GOLDEN_NOISE_BURSTS:
+		case GOLDEN_COLLAPSE_TRAIN: {
+			// 10 ms bursts every 100 ms
+			for (int i = 0; i < GOLDEN_FRAMES; i++) {
+				if (i % (GOLDEN_SAMPLE_RATE / 10) < GOLDEN_SAMPLE_RATE / 100) {
+					left[i] = 5.f * noise();
+					right[i] = 5.f * noise();
+				}
+			}
+		} break;
+	}
+}
+
+static std::vector<GoldenCase> goldenCases() {
+	static const char* interpolationNames[] = {"linear", "cubic"};
+	static const char* formatNames[] = {"float", "half"};
+
+	std::vector<GoldenCase> cases;
+	for (int stimulus = 0; stimulus < GOLDEN_STIMULI_LEN; stimulus++) {
+		for (int t = 0; t < QUANTUM_TAP_COUNTS_LEN; t++) {
+			for (int interpolation = 0; interpolation < INTERP_LEN; interpolation++) {
+				for (int format = 0; format < SAMPLE_FORMATS_LEN; format++) {
+					GoldenCase c;
+					c.stimulus = stimulus;
+					c.taps = QUANTUM_TAP_COUNTS[t];
+					c.interpolation = interpolation;
+					c.sampleFormat = format;
+					char name[64];
+					std::snprintf(name, sizeof(name), "%s_%d_%s_%s", GOLDEN_STIMULUS_NAMES[stimulus], c.taps, interpolationNames[interpolation], formatNames[format]);
+					c.name = name;
+
+					// Settings that reach every branch of the weight, delay and pan updates
+					Automation& a = c.automation;
+					a.curves["delay"] = {{0.0, 0.05f}};
+					a.curves["feedback"] = {{0.0, 0.6f}};
+					a.curves["chaos"] = {{0.0, 0.4f}};
+					a.curves["probability"] = {{0.0, 0.8f}, {1.0, 0.2f}};
+					a.curves["panmode"] = {{0.0, (float)PAN_CHAOS}, {0.75, (float)PAN_WEIGHTS}};
+					if (stimulus == GOLDEN_SWEEP)
+						a.curves["midside"] = {{0.0, 1.f}};
+					if (stimulus == GOLDEN_COLLAPSE_TRAIN) {
+						for (double time = 0.05; time < (double)GOLDEN_FRAMES / GOLDEN_SAMPLE_RATE; time += 0.25)
+							a.collapses.push_back(time);
+					}
+					cases.push_back(c);
+				}
+			}
+		}
+	}
+	return cases;
+}
+
+static void renderCase(const GoldenCase& c, std::vector<float>& outL, std::vector<float>& outR) {
+	std::vector<float> inL, inR;
+	generateStimulus(c.stimulus, inL, inR);
+	outL.resize(GOLDEN_FRAMES);
+	outR.resize(GOLDEN_FRAMES);
+
+	std::unique_ptr<QuantumEngineBase> engine(createQuantumEngine(c.taps, c.interpolation, c.sampleFormat));
+	prepareEngine(engine.get(), GOLDEN_SEED, GOLDEN_SAMPLE_RATE);
+	size_t nextCollapse = 0;
+	for (int position = 0; position < GOLDEN_FRAMES; position += BLOCK_FRAMES) {
+		int frames = std::min(BLOCK_FRAMES, GOLDEN_FRAMES - position);
+		processAutomated(engine.get(), c.automation, GOLDEN_SAMPLE_RATE, position, &nextCollapse,
+			&inL[position], &inR[position], &outL[position], &outR[position], frames);
+	}
+	for (int i = 0; i < GOLDEN_FRAMES; i++) {
+		outL[i] /= VOLTS_PER_UNIT;
+		outR[i] /= VOLTS_PER_UNIT;
+	}
+}
+
+static GoldenResult checkCase(const GoldenCase& c, const std::string& dir, bool write, int tier) {
+	GoldenResult result;
+	std::vector<float> outL, outR;
+	renderCase(c, outL, outR);
+	std::string path = dir + "/" + c.name + ".wav";
+
+	if (write) {
+		WavWriter writer;
+		result.ok = writer.open(path, 2, GOLDEN_SAMPLE_RATE, &result.message)
+			&& writer.write(outL.data(), outR.data(), GOLDEN_FRAMES)
+			&& writer.close();
+		if (!result.ok && result.message.empty())
+			result.message = "write failed: " + path;
+		return result;
+	}
+
+	WavReader reader;
+	if (!reader.open(path, &result.message))
+		return result;
+	if (reader.frames != GOLDEN_FRAMES || reader.sampleRate != GOLDEN_SAMPLE_RATE || reader.encoding != WAV_FLOAT) {
+		result.message = path + ": reference format or length differs";
+		return result;
+	}
+	std::vector<float> refL(GOLDEN_FRAMES), refR(GOLDEN_FRAMES);
+	reader.read(refL.data(), refR.data(), GOLDEN_FRAMES);
+
+	double maxError = 0.0;
+	double errorSum = 0.0;
+	int firstDiff = -1;
+	for (int i = 0; i < GOLDEN_FRAMES; i++) {
+		for (int ch = 0; ch < 2; ch++) {
+			float out = ch ? outR[i] : outL[i];
+			float ref = ch ? refR[i] : refL[i];
+			if (firstDiff < 0 && std::memcmp(&out, &ref, sizeof(float)))
+				firstDiff = i;
+			double error = (out == ref) ? 0.0 : std::fabs((double)out - ref);
+			// NaN never compares equal, count it as an infinite error
+			if (std::isnan(error))
+				error = INFINITY;
+			maxError = std::max(maxError, error);
+			errorSum += error * error;
+		}
+	}
+	double errorRmsDb = 10.0 * std::log10(std::max(errorSum / (2.0 * GOLDEN_FRAMES), 1e-30));
+
+	switch (tier) {
+		case TIER_EXACT: result.ok = (firstDiff < 0); break;
+		case TIER_SIMD: result.ok = (maxError <= 1e-5); break;
+		case TIER_FAST: result.ok = (maxError <= 1e-3 && errorRmsDb <= -80.0); break;
+	}
+	if (firstDiff >= 0) {
+		char message[256];
+		std::snprintf(message, sizeof(message), "%s: first difference at frame %d, max error %.3g, error RMS %.1f dBFS", c.name.c_str(), firstDiff, maxError, errorRmsDb);
+		result.message = message;
+	}
+	return result;
+}
+
+static int goldenUsage() {
+	std::fprintf(stderr, "usage: QuantumRender golden [-d dir] [--write] [--tier exact|simd|fast] [-j threads]\n");
+	return 2;
+}
+
+int goldenMain(int argc, char** argv) {
+	std::string dir = "golden";
+	bool write = false;
+	int tier = TIER_EXACT;
+	int threads = 0;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (arg == "-d" && hasValue)
+			dir = argv[++i];
+		else if (arg == "--write")
+			write = true;
+		else if (arg == "-j" && hasValue)
+			threads = std::atoi(argv[++i]);
+		else if (arg == "--tier" && hasValue) {
+			std::string name = argv[++i];
+			if (name == "exact")
+				tier = TIER_EXACT;
+			else if (name == "simd")
+				tier = TIER_SIMD;
+			else if (name == "fast")
+				tier = TIER_FAST;
+			else
+				return goldenUsage();
+		} else
+			return goldenUsage();
+	}
+
+	std::string error;
+	if (write && !makeDirectories(dir, &error)) {
+		std::fprintf(stderr, "%s\n", error.c_str());
+		return 1;
+	}
+
+	std::vector<GoldenCase> cases = goldenCases();
+	std::vector<GoldenResult> results(cases.size());
+	threads = (threads > 0) ? threads : (int)std::thread::hardware_concurrency();
+	WorkStealingPool pool(clamp(threads, 1, (int)cases.size()));
+	for (size_t i = 0; i < cases.size(); i++) {
+		pool.submit([&, i]() {
+			results[i] = checkCase(cases[i], dir, write, tier);
+		});
+	}
+	pool.run();
+
+	int failures = 0;
+	for (const GoldenResult& result : results) {
+		if (!result.ok) {
+			std::fprintf(stderr, "FAIL %s\n", result.message.c_str());
+			failures++;
+		} else if (!result.message.empty()) {
+			// Within tolerance but not bit-exact
+			std::printf("ok   %s\n", result.message.c_str());
+		}
+	}
+	std::printf("%s %d cases, %d failed\n", write ? "recorded" : "checked", (int)cases.size(), failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,245 @@
+// Offline renderer for the Quantum Superposition engine.
+//
+// Renders WAV files through the same engine the Rack module runs, with optional
+// parameter automation, spreading every (input, parameter set) job across a
+// work-stealing thread pool. Audio is streamed block by block, so memory does
+// not grow with file length.
+//
+// Build against the Rack SDK headers:
+//   g++ -std=c++11 -O3 -march=nehalem -I$RACK_DIR/include -I$RACK_DIR/dep/include
+//       tools/*.cpp QuantumSuperpositionEngine.cpp -o QuantumRender -lpthread
+//
+// Usage:
+//   QuantumRender [options] input.wav...
+//     -o DIR       output directory (default .)
+//     -p FILE      parameter/automation file, repeatable; each one is rendered against every input
+//     -s SEED      base random seed (default 1)
+//     -j N         worker threads (default: all cores)
+//     -t SECONDS   silence appended to let the delays ring out (default 2)
+//   QuantumRender sweep [options] [stimulus.wav]
+//     parameter-space exploration, see QuantumSweep.cpp
+//   QuantumRender golden [options]
+//     regression check against recorded reference renders, see QuantumGolden.cpp
+//   QuantumRender fuzz [options]
+//     hostile input and fault recovery fuzzing, see QuantumFuzz.cpp
+//   QuantumRender bench [options]
+//     cache and TLB counters for buffer layouts and engine specialisations, see QuantumBench.cpp
+//   QuantumRender collapse [options]
+//     trigger-to-output latency of collapse events, see QuantumCollapse.cpp
+//
+// Parameter files hold one statement per line, `#` starts a comment:
+//   taps 8                 engine configuration: taps, interpolation (linear|cubic), memory (float|half),
+//                          oversample (1|2|4), tape (minutes of tape mode history, 0 for off),
+//                          preload (WAV file whose last moments fill the history before the input)
+//   feedback 0.6           initial value
+//   2.5 feedback 0.9       breakpoint at 2.5 s, values ramp linearly between breakpoints
+//   4.0 collapse           collapse the superposition at 4 s, on the first frame at or after it
+// Automatable parameters use the module's knob ranges: delay, spread, probability,
+// feedback, mix, chaos, width, grainsize, graindensity, tone, tonespread, moddepth, modrate (0-1),
+// panmode (static|weights|chaos), modshape (sine|triangle|noise),
+// midside, freeze, granular, varispeed, multiband, spectral, hardcollapse (0|1).
+// Spectral mode delays the wet path by 1024 frames and oversampling the whole output by
+// about 25, reported per render.
+
+#include "QuantumTool.hpp"
+
+struct RenderJob {
+	std::string inputPath;
+	std::string outputPath;
+	const Automation* automation;
+	uint32_t seed;
+};
+
+struct RenderOptions {
+	std::string outputDir = ".";
+	uint32_t seed = 1;
+	int threads = 0;
+	double tail = 2.0;
+};
+
+struct RenderStats {
+	int64_t frames = 0;
+	double seconds = 0.0;
+	int latency = 0; // largest wet path latency seen, in frames
+};
+
+static bool renderFile(const RenderJob& job, const RenderOptions& options, RenderStats* stats, std::string* error) {
+	WavReader reader;
+	if (!reader.open(job.inputPath, error))
+		return false;
+
+	const Automation& automation = *job.automation;
+	std::unique_ptr<QuantumEngineBase> engine(createQuantumEngine(automation.taps, automation.interpolation, automation.sampleFormat, automation.oversampling));
+	if (automation.tapeMinutes > 0.f) {
+		// Offline, a page fault only costs time, so the tape is not prefetched
+		double frames = automation.tapeMinutes * 60.0 * reader.sampleRate * automation.oversampling;
+		engine->setTape(new QuantumTape(job.outputPath + ".tape", (int) std::min(frames, (double) QuantumTape::MAX_FRAMES), false));
+	}
+	prepareEngine(engine.get(), job.seed, reader.sampleRate);
+	if (!automation.preloadPath.empty()) {
+		WavMapping sample;
+		if (!sample.open(automation.preloadPath, error))
+			return false;
+		WavTailResampler resampler(sample, (double) reader.sampleRate * automation.oversampling, engine->getHistoryFrames());
+		std::unique_ptr<QuantumHistory> history(engine->buildHistory([&](float* frames, int count) {
+			int read = resampler.read(frames, count);
+			for (int i = 0; i < read * 2; i++)
+				frames[i] *= VOLTS_PER_UNIT;
+			return read;
+		}));
+		if (!history) {
+			*error = "no memory for the preloaded tape";
+			return false;
+		}
+		history.reset(engine->swapHistory(history.release()));
+	}
+
+	WavWriter writer;
+	if (!writer.open(job.outputPath, 2, reader.sampleRate, error))
+		return false;
+
+	std::vector<float> inL(BLOCK_FRAMES), inR(BLOCK_FRAMES), outL(BLOCK_FRAMES), outR(BLOCK_FRAMES);
+	int64_t tailFrames = (int64_t)(options.tail * reader.sampleRate);
+	int64_t position = 0;
+	size_t nextCollapse = 0;
+
+	while (true) {
+		int frames = reader.read(inL.data(), inR.data(), BLOCK_FRAMES);
+		if (frames == 0) {
+			if (tailFrames <= 0)
+				break;
+			frames = (int)std::min<int64_t>(BLOCK_FRAMES, tailFrames);
+			tailFrames -= frames;
+			std::fill(inL.begin(), inL.begin() + frames, 0.f);
+			std::fill(inR.begin(), inR.begin() + frames, 0.f);
+		}
+
+		for (int i = 0; i < frames; i++) {
+			inL[i] *= VOLTS_PER_UNIT;
+			inR[i] *= VOLTS_PER_UNIT;
+		}
+
+		processAutomated(engine.get(), automation, reader.sampleRate, position, &nextCollapse, inL.data(), inR.data(), outL.data(), outR.data(), frames);
+		stats->latency = std::max(stats->latency, engine->getLatency());
+
+		for (int i = 0; i < frames; i++) {
+			outL[i] /= VOLTS_PER_UNIT;
+			outR[i] /= VOLTS_PER_UNIT;
+		}
+		if (!writer.write(outL.data(), outR.data(), frames)) {
+			*error = "write failed: " + job.outputPath;
+			return false;
+		}
+		position += frames;
+	}
+
+	if (!writer.close()) {
+		*error = "write failed: " + job.outputPath;
+		return false;
+	}
+	stats->frames = position;
+	stats->seconds = (double)position / reader.sampleRate;
+	return true;
+}
+
+static int usage() {
+	std::fprintf(stderr, "usage: QuantumRender [-o dir] [-p params]... [-s seed] [-j threads] [-t tail] input.wav...\n");
+	return 2;
+}
+
+int main(int argc, char** argv) {
+	if (argc > 1 && std::string(argv[1]) == "sweep")
+		return sweepMain(argc - 1, argv + 1);
+	if (argc > 1 && std::string(argv[1]) == "golden")
+		return goldenMain(argc - 1, argv + 1);
+	if (argc > 1 && std::string(argv[1]) == "fuzz")
+		return fuzzMain(argc - 1, argv + 1);
+	if (argc > 1 && std::string(argv[1]) == "bench")
+		return benchMain(argc - 1, argv + 1);
+	if (argc > 1 && std::string(argv[1]) == "collapse")
+		return collapseMain(argc - 1, argv + 1);
+
+	RenderOptions options;
+	std::vector<std::string> inputs;
+	std::vector<std::string> paramPaths;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		bool hasValue = (i + 1 < argc);
+		if (arg == "-o" && hasValue)
+			options.outputDir = argv[++i];
+		else if (arg == "-p" && hasValue)
+			paramPaths.push_back(argv[++i]);
+		else if (arg == "-s" && hasValue)
+			options.seed = std::strtoul(argv[++i], nullptr, 0);
+		else if (arg == "-j" && hasValue)
+			options.threads = std::atoi(argv[++i]);
+		else if (arg == "-t" && hasValue)
+			options.tail = std::max(0.0, std::atof(argv[++i]));
+		else if (!arg.empty() && arg[0] == '-')
+			return usage();
+		else
+			inputs.push_back(arg);
+	}
+	if (inputs.empty())
+		return usage();
+
+	// One default parameter set when none is given
+	std::vector<Automation> automations(std::max<size_t>(paramPaths.size(), 1));
+	for (size_t i = 0; i < paramPaths.size(); i++) {
+		std::string error;
+		if (!automations[i].load(paramPaths[i], &error)) {
+			std::fprintf(stderr, "%s\n", error.c_str());
+			return 1;
+		}
+		automations[i].name = pathStem(paramPaths[i]);
+	}
+	if (paramPaths.empty())
+		automations[0].name = "qsd";
+
+	// Seeds depend only on the base seed and the job's name, never on scheduling or argument order
+	std::vector<RenderJob> jobs;
+	for (const std::string& input : inputs) {
+		for (const Automation& automation : automations) {
+			RenderJob job;
+			job.inputPath = input;
+			job.outputPath = options.outputDir + "/" + pathStem(input) + "_" + automation.name + ".wav";
+			job.automation = &automation;
+			job.seed = options.seed ^ hashString(pathStem(input) + "/" + automation.name);
+			jobs.push_back(job);
+		}
+	}
+
+	int threads = (options.threads > 0) ? options.threads : (int)std::thread::hardware_concurrency();
+	threads = clamp(threads, 1, (int)jobs.size());
+	WorkStealingPool pool(threads);
+	std::mutex printMutex;
+	std::atomic<int> failures{0};
+
+	auto start = std::chrono::steady_clock::now();
+	for (const RenderJob& job : jobs) {
+		pool.submit([&, job]() {
+			auto jobStart = std::chrono::steady_clock::now();
+			RenderStats stats;
+			std::string error;
+			bool ok = renderFile(job, options, &stats, &error);
+			double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - jobStart).count();
+
+			std::lock_guard<std::mutex> lock(printMutex);
+			if (ok) {
+				std::printf("%s -> %s: %.2f s audio, %.1fx real time", job.inputPath.c_str(), job.outputPath.c_str(), stats.seconds, stats.seconds / std::max(elapsed, 1e-9));
+				if (stats.latency > 0)
+					std::printf(", wet path %d frames late", stats.latency);
+				std::printf("\n");
+			} else {
+				std::fprintf(stderr, "%s\n", error.c_str());
+				failures++;
+			}
+		});
+	}
+	pool.run();
+
+	double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	std::printf("%d jobs on %d threads in %.2f s\n", (int)jobs.size(), threads, elapsed);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,404 @@
+#pragma once
+// Shared pieces of the offline tools: parameter automation, the work-stealing pool and helpers.
+
+#include "../QuantumSuperpositionEngine.hpp"
+#include "../QuantumWav.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+// Rack's ±5 V audio convention, full scale in a WAV file
+static constexpr float VOLTS_PER_UNIT = 5.f;
+// Automation is evaluated at the engine's control rate
+static constexpr int AUTOMATION_INTERVAL = 64;
+static constexpr int BLOCK_FRAMES = 4096;
+
+struct Breakpoint {
+	double time;
+	float value;
+};
+
+struct Automation {
+	std::string name;
+	int taps = 6;
+	int interpolation = INTERP_LINEAR;
+	int sampleFormat = SAMPLE_FLOAT;
+	int oversampling = 1;
+	float tapeMinutes = 0.f; // tape mode history, 0 for the plain buffers
+	std::string preloadPath; // WAV whose tail fills the history before the first frame
+	std::map<std::string, std::vector<Breakpoint>> curves;
+	std::vector<double> collapses;
+
+	static bool isParam(const std::string& key) {
+		static const char* params[] = {"delay", "spread", "probability", "feedback", "mix", "chaos", "width", "panmode", "midside", "freeze", "granular", "grainsize", "graindensity", "varispeed", "multiband", "spectral", "tone", "tonespread", "moddepth", "modrate", "modshape", "hardcollapse"};
+		for (const char* param : params) {
+			if (key == param)
+				return true;
+		}
+		return false;
+	}
+
+	static bool parseValue(const std::string& key, const std::string& text, float* value) {
+		if (key == "panmode") {
+			static const char* modes[] = {"static", "weights", "chaos"};
+			for (int i = 0; i < PAN_MODES_LEN; i++) {
+				if (text == modes[i]) {
+					*value = i;
+					return true;
+				}
+			}
+		}
+		if (key == "modshape") {
+			static const char* shapes[] = {"sine", "triangle", "noise"};
+			for (int i = 0; i < LFO_SHAPES_LEN; i++) {
+				if (text == shapes[i]) {
+					*value = i;
+					return true;
+				}
+			}
+		}
+		if ((key == "midside" || key == "freeze" || key == "granular" || key == "varispeed" || key == "multiband" || key == "spectral" || key == "hardcollapse") && (text == "on" || text == "off")) {
+			*value = (text == "on");
+			return true;
+		}
+		char* end;
+		*value = std::strtof(text.c_str(), &end);
+		return end != text.c_str() && *end == '\0';
+	}
+
+	bool load(const std::string& path, std::string* error) {
+		std::ifstream file(path);
+		if (!file) {
+			*error = "cannot open " + path;
+			return false;
+		}
+
+		std::string line;
+		int lineNumber = 0;
+		while (std::getline(file, line)) {
+			lineNumber++;
+			size_t comment = line.find('#');
+			if (comment != std::string::npos)
+				line.resize(comment);
+
+			std::istringstream tokens(line);
+			std::vector<std::string> words;
+			std::string word;
+			while (tokens >> word)
+				words.push_back(word);
+			if (words.empty())
+				continue;
+
+			std::string where = path + ":" + std::to_string(lineNumber) + ": ";
+			char* end;
+			double time = std::strtod(words[0].c_str(), &end);
+			bool timed = (end != words[0].c_str() && *end == '\0');
+			if (timed)
+				words.erase(words.begin());
+
+			if (timed && words.size() == 1 && words[0] == "collapse") {
+				collapses.push_back(time);
+				continue;
+			}
+			if (words.size() != 2) {
+				*error = where + "expected [time] name value";
+				return false;
+			}
+
+			const std::string& key = words[0];
+			if (!timed && key == "taps") {
+				taps = std::atoi(words[1].c_str());
+				bool valid = false;
+				for (int i = 0; i < QUANTUM_TAP_COUNTS_LEN; i++)
+					valid |= (taps == QUANTUM_TAP_COUNTS[i]);
+				if (!valid) {
+					*error = where + "taps must be 4, 6, 8 or 16";
+					return false;
+				}
+			} else if (!timed && key == "interpolation") {
+				interpolation = (words[1] == "cubic") ? INTERP_CUBIC : INTERP_LINEAR;
+			} else if (!timed && key == "memory") {
+				sampleFormat = (words[1] == "half") ? SAMPLE_HALF : SAMPLE_FLOAT;
+			} else if (!timed && key == "oversample") {
+				oversampling = std::atoi(words[1].c_str());
+				if (oversampling != 1 && oversampling != 2 && oversampling != 4) {
+					*error = where + "oversample must be 1, 2 or 4";
+					return false;
+				}
+			} else if (!timed && key == "tape") {
+				tapeMinutes = std::strtof(words[1].c_str(), &end);
+				if (end == words[1].c_str() || *end != '\0' || !(tapeMinutes >= 0.f && tapeMinutes <= 60.f)) {
+					*error = where + "tape must be 0 to 60 minutes";
+					return false;
+				}
+			} else if (!timed && key == "preload") {
+				preloadPath = words[1];
+			} else if (isParam(key)) {
+				float value;
+				if (!parseValue(key, words[1], &value)) {
+					*error = where + "bad value '" + words[1] + "'";
+					return false;
+				}
+				curves[key].push_back({timed ? time : 0.0, value});
+			} else {
+				*error = where + "unknown parameter '" + key + "'";
+				return false;
+			}
+		}
+
+		for (auto& curve : curves) {
+			std::stable_sort(curve.second.begin(), curve.second.end(), [](const Breakpoint& a, const Breakpoint& b) {
+				return a.time < b.time;
+			});
+		}
+		std::sort(collapses.begin(), collapses.end());
+		return true;
+	}
+
+	static float evaluate(const std::vector<Breakpoint>& curve, double time, bool stepped) {
+		auto next = std::upper_bound(curve.begin(), curve.end(), time, [](double t, const Breakpoint& b) {
+			return t < b.time;
+		});
+		if (next == curve.begin())
+			return curve.front().value;
+		if (next == curve.end() || stepped)
+			return (next - 1)->value;
+		const Breakpoint& prev = *(next - 1);
+		float t = (float)((time - prev.time) / (next->time - prev.time));
+		return prev.value + (next->value - prev.value) * t;
+	}
+
+	void apply(QuantumControls& controls, double time) const {
+		for (const auto& curve : curves) {
+			const std::string& key = curve.first;
+			bool stepped = (key == "panmode" || key == "modshape" || key == "midside" || key == "freeze" || key == "granular" || key == "varispeed" || key == "multiband" || key == "spectral" || key == "hardcollapse");
+			float value = evaluate(curve.second, time, stepped);
+			if (key == "delay")
+				controls.delayTime = clamp(value, 0.f, 1.f);
+			else if (key == "spread")
+				controls.spread = clamp(value, 0.f, 1.f);
+			else if (key == "probability")
+				controls.probability = clamp(value, 0.f, 1.f);
+			else if (key == "feedback")
+				controls.feedback = clamp(value, 0.f, 0.95f);
+			else if (key == "mix")
+				controls.mix = clamp(value, 0.f, 1.f);
+			else if (key == "chaos")
+				controls.chaos = clamp(value, 0.f, 1.f);
+			else if (key == "width")
+				controls.width = clamp(value, 0.f, 1.f);
+			else if (key == "panmode")
+				controls.panMode = clamp((int)value, 0, PAN_MODES_LEN - 1);
+			else if (key == "midside")
+				controls.midSide = (value >= 0.5f);
+			else if (key == "freeze")
+				controls.freeze = (value >= 0.5f);
+			else if (key == "granular")
+				controls.granular = (value >= 0.5f);
+			else if (key == "grainsize")
+				controls.grainSize = clamp(value, 0.f, 1.f);
+			else if (key == "graindensity")
+				controls.grainDensity = clamp(value, 0.f, 1.f);
+			else if (key == "varispeed")
+				controls.varispeed = (value >= 0.5f);
+			else if (key == "multiband")
+				controls.multiband = (value >= 0.5f);
+			else if (key == "spectral")
+				controls.spectral = (value >= 0.5f);
+			else if (key == "tone")
+				controls.feedbackTone = clamp(value, 0.f, 1.f);
+			else if (key == "tonespread")
+				controls.toneSpread = clamp(value, 0.f, 1.f);
+			else if (key == "moddepth")
+				controls.modDepth = clamp(value, 0.f, 1.f);
+			else if (key == "modrate")
+				controls.modRate = clamp(value, 0.f, 1.f);
+			else if (key == "modshape")
+				controls.modShape = clamp((int)value, 0, LFO_SHAPES_LEN - 1);
+			else if (key == "hardcollapse")
+				controls.hardCollapse = (value >= 0.5f);
+		}
+	}
+};
+
+// Per-worker deques: owners push and pop at the back, idle workers steal from the front of the others.
+// Tasks may submit more tasks; run() returns once every task, including those, has finished.
+struct WorkStealingPool {
+	struct Worker {
+		std::mutex mutex;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::atomic<int> pending{0};
+	std::atomic<int> nextWorker{0};
+	std::mutex idleMutex;
+	std::condition_variable idle;
+
+	static int& currentWorker() {
+		static thread_local int index = -1;
+		return index;
+	}
+
+	explicit WorkStealingPool(int threads) {
+		for (int i = 0; i < std::max(threads, 1); i++)
+			workers.emplace_back(new Worker);
+	}
+
+	void submit(std::function<void()> task) {
+		int index = currentWorker();
+		if (index < 0)
+			index = nextWorker++ % (int)workers.size();
+		pending++;
+		{
+			std::lock_guard<std::mutex> lock(workers[index]->mutex);
+			workers[index]->tasks.push_back(std::move(task));
+		}
+		idle.notify_one();
+	}
+
+	bool take(int self, std::function<void()>* task) {
+		int count = workers.size();
+		for (int i = 0; i < count; i++) {
+			int victim = (self + i) % count;
+			Worker& worker = *workers[victim];
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			if (worker.tasks.empty())
+				continue;
+			if (victim == self) {
+				*task = std::move(worker.tasks.back());
+				worker.tasks.pop_back();
+			} else {
+				*task = std::move(worker.tasks.front());
+				worker.tasks.pop_front();
+			}
+			return true;
+		}
+		return false;
+	}
+
+	void workerLoop(int self) {
+		currentWorker() = self;
+		std::function<void()> task;
+		while (true) {
+			if (take(self, &task)) {
+				task();
+				task = nullptr;
+				if (--pending == 0)
+					idle.notify_all();
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(idleMutex);
+			if (pending == 0)
+				break;
+			// Woken by submit() or the last task finishing, the timeout covers a lost wakeup
+			idle.wait_for(lock, std::chrono::milliseconds(1));
+		}
+		currentWorker() = -1;
+	}
+
+	void run() {
+		std::vector<std::thread> threads;
+		for (int i = 0; i < (int)workers.size(); i++)
+			threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+		for (std::thread& thread : threads)
+			thread.join();
+	}
+};
+
+inline std::string pathStem(const std::string& path) {
+	size_t slash = path.find_last_of("/\\");
+	std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	return (dot == std::string::npos || dot == 0) ? name : name.substr(0, dot);
+}
+
+// Creates the directory and any missing parents, like mkdir -p
+inline bool makeDirectories(const std::string& path, std::string* error) {
+	for (size_t end = 0; end != std::string::npos;) {
+		end = path.find_first_of("/\\", end + 1);
+		std::string prefix = path.substr(0, end);
+		struct stat info;
+		if (prefix.empty() || stat(prefix.c_str(), &info) == 0)
+			continue;
+#ifdef _WIN32
+		int failed = _mkdir(prefix.c_str());
+#else
+		int failed = mkdir(prefix.c_str(), 0755);
+#endif
+		if (failed && stat(prefix.c_str(), &info) != 0) {
+			*error = "cannot create " + prefix;
+			return false;
+		}
+	}
+	return true;
+}
+
+// FNV-1a, used to derive per-job seeds
+inline uint32_t hashString(const std::string& s) {
+	uint32_t hash = 2166136261u;
+	for (char c : s) {
+		hash ^= (uint8_t)c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Seeds and clears an engine and loads the module's default knob positions, without allocating
+inline void prepareEngine(QuantumEngineBase* engine, uint32_t seed, float sampleRate) {
+	engine->seed(seed);
+	engine->reset();
+	engine->controls = QuantumControls();
+	engine->controls.sampleRate = sampleRate;
+	// Renders are always stereo
+	engine->controls.width = 0.5f;
+}
+
+// Runs `frames` frames through the engine in control-rate slices, applying automation and
+// collapse events. `position` is the frame index of inL[0]; `nextCollapse` tracks fired events.
+// A collapse lands on the first frame at or after its time, splitting the slice there.
+inline void processAutomated(QuantumEngineBase* engine, const Automation& automation, double sampleRate, int64_t position, size_t* nextCollapse, const float* inL, const float* inR, float* outL, float* outR, int frames) {
+	for (int offset = 0; offset < frames; offset += AUTOMATION_INTERVAL) {
+		int count = std::min(AUTOMATION_INTERVAL, frames - offset);
+		double time = (double)(position + offset) / sampleRate;
+		automation.apply(engine->controls, time);
+		// Where the module's widget would have allocated it
+		if (engine->controls.spectral)
+			engine->prepareSpectral();
+		int done = 0;
+		while (done < count) {
+			int end = count;
+			while (*nextCollapse < automation.collapses.size()) {
+				int64_t frame = (int64_t) std::ceil(automation.collapses[*nextCollapse] * sampleRate) - position - offset;
+				if (frame > done) {
+					end = std::min<int64_t>(frame, count);
+					break;
+				}
+				engine->collapse();
+				(*nextCollapse)++;
+			}
+			engine->processBlock(&inL[offset + done], &inR[offset + done], &outL[offset + done], &outR[offset + done], end - done);
+			done = end;
+		}
+	}
+}
+
+int sweepMain(int argc, char** argv);
+int goldenMain(int argc, char** argv);
+int fuzzMain(int argc, char** argv);
+int benchMain(int argc, char** argv);
+int collapseMain(int argc, char** argv);